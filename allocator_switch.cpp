@@ -0,0 +1,687 @@
+/**************************************************************************/
+/*  allocator_switch.cpp                                                  */
+/**************************************************************************/
+/*                         This file is part of:                          */
+/*                             GODOT ENGINE                               */
+/*                        https://godotengine.org                         */
+/**************************************************************************/
+/* Copyright (c) 2014-present Godot Engine contributors (see AUTHORS.md). */
+/* Copyright (c) 2007-2014 Juan Linietsky, Ariel Manzur.                  */
+/*                                                                        */
+/* Permission is hereby granted, free of charge, to any person obtaining  */
+/* a copy of this software and associated documentation files (the        */
+/* "Software"), to deal in the Software without restriction, including    */
+/* without limitation the rights to use, copy, modify, merge, publish,    */
+/* distribute, sublicense, and/or sell copies of the Software, and to     */
+/* permit persons to whom the Software is furnished to do so, subject to  */
+/* the following conditions:                                              */
+/*                                                                        */
+/* The above copyright notice and this permission notice shall be         */
+/* included in all copies or substantial portions of the Software.        */
+/*                                                                        */
+/* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,        */
+/* EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF     */
+/* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. */
+/* IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY   */
+/* CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,   */
+/* TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE      */
+/* SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.                 */
+/**************************************************************************/
+
+#include "allocator_switch.h"
+
+#ifdef SWITCH_ARENA_ALLOCATOR_ENABLED
+
+#ifdef __SWITCH__
+#include "switch_wrapper.h"
+
+#include <reent.h>
+#include <unistd.h>
+
+extern "C" {
+void __malloc_lock(struct _reent *p_reent);
+void __malloc_unlock(struct _reent *p_reent);
+}
+
+// newlib's malloc grows its heap under this lock, and libnx's sbrk checks every
+// request against fake_heap_end, so moving it under the lock is all it takes
+// to hand memory over in either direction.
+static inline void lock_newlib() { __malloc_lock(_REENT); }
+static inline void unlock_newlib() { __malloc_unlock(_REENT); }
+static inline char *get_newlib_top() { return (char *)sbrk(0); }
+#else
+// Host build, see tests/bench_allocator_switch.cpp. The benchmark maps a range
+// of its own for the fake heap, newlib isn't in it.
+#include <pthread.h>
+
+typedef pthread_mutex_t LibnxMutex;
+static inline void mutexInit(LibnxMutex *p_mutex) { pthread_mutex_init(p_mutex, NULL); }
+static inline void mutexLock(LibnxMutex *p_mutex) { pthread_mutex_lock(p_mutex); }
+static inline void mutexUnlock(LibnxMutex *p_mutex) { pthread_mutex_unlock(p_mutex); }
+
+extern "C" char *fake_heap_start;
+static inline void lock_newlib() {}
+static inline void unlock_newlib() {}
+static inline char *get_newlib_top() { return fake_heap_start; }
+#endif
+
+#include <malloc.h>
+#include <pthread.h>
+#include <string.h>
+#include <atomic>
+
+extern "C" {
+void *__real_malloc(size_t p_size);
+void __real_free(void *p_ptr);
+void *__real_calloc(size_t p_count, size_t p_size);
+void *__real_realloc(void *p_ptr, size_t p_size);
+size_t __real_malloc_usable_size(void *p_ptr);
+
+void *__wrap_malloc(size_t p_size);
+void __wrap_free(void *p_ptr);
+void *__wrap_calloc(size_t p_count, size_t p_size);
+void *__wrap_realloc(void *p_ptr, size_t p_size);
+size_t __wrap_malloc_usable_size(void *p_ptr);
+
+#ifdef __SWITCH__
+// newlib's own code calls the reentrant variants directly, with pointers it may
+// have been handed by the wrapped functions above.
+void __real__free_r(struct _reent *p_reent, void *p_ptr);
+void *__real__realloc_r(struct _reent *p_reent, void *p_ptr, size_t p_size);
+size_t __real__malloc_usable_size_r(struct _reent *p_reent, void *p_ptr);
+
+void __wrap__free_r(struct _reent *p_reent, void *p_ptr);
+void *__wrap__realloc_r(struct _reent *p_reent, void *p_ptr, size_t p_size);
+size_t __wrap__malloc_usable_size_r(struct _reent *p_reent, void *p_ptr);
+#endif
+
+// Heap bounds set up by libnx for newlib's sbrk.
+extern char *fake_heap_end;
+}
+
+// Blocks are 16-byte aligned and carry their size in the 8 bytes in front of
+// them. A free block also keeps its size in its last 8 bytes, so freeing the
+// next one can find it and merge.
+#define ALIGNMENT 16
+#define HEADER_SIZE 8
+#define MIN_BLOCK_SIZE 32
+#define MAX_BLOCK_SIZE ((size_t)1 << 36)
+
+#define BLOCK_FREE 1
+#define BLOCK_PREV_FREE 2
+#define BLOCK_FLAGS (BLOCK_FREE | BLOCK_PREV_FREE)
+
+// Free lists are split by powers of two, and each power into 16 steps. Sizes
+// under 256 bytes get a list per 16 bytes.
+#define SL_SHIFT 4
+#define SL_COUNT (1 << SL_SHIFT)
+#define LINEAR_SHIFT 8
+#define FL_COUNT 32
+#define FIT_SEARCH_LIMIT 8
+
+// Blocks up to this size go back to a per-thread list when freed, and are
+// handed out again from there without taking the lock.
+#define MAX_CACHED_SIZE 1024
+#define CACHE_CLASS_COUNT ((MAX_CACHED_SIZE >> 4) + 1)
+#define CACHE_LIMIT 4
+
+// The region grows down from the top of the heap in steps of this size, and a
+// free stretch this large at its bottom goes back to newlib.
+#define REGION_STEP ((size_t)1 << 12)
+#define REGION_TRIM ((size_t)1 << 16)
+
+// The first field belongs to the previous block and is only valid while that
+// one is free. The free list links overlay the data of a free block.
+struct Block {
+	size_t prev_size;
+	size_t size;
+	Block *next_free;
+	Block *prev_free;
+};
+
+struct ThreadCache {
+	Block *head[CACHE_CLASS_COUNT]; // linked through next_free
+	uint8_t count[CACHE_CLASS_COUNT];
+};
+
+static bool initialized = false;
+static LibnxMutex global_mutex;
+
+static uint32_t fl_bitmap = 0;
+static uint32_t sl_bitmap[FL_COUNT];
+static Block *free_lists[FL_COUNT][SL_COUNT];
+static Block *free_tails[FL_COUNT][SL_COUNT];
+
+// Only ever grows down or trims from the bottom while no block in the range
+// moved is live, so checking a pointer against it needs no lock.
+static std::atomic<uintptr_t> region_base(0);
+static uintptr_t region_top = 0;
+static uint64_t used_bytes = 0;
+static uint64_t peak_reserved_bytes = 0;
+
+static pthread_key_t cache_key;
+static __thread ThreadCache *thread_cache = NULL;
+static __thread bool creating_cache = false;
+static __thread bool cache_released = false;
+
+static void release_thread_cache(void *p_cache);
+
+static inline size_t get_size(const Block *p_block) {
+	return p_block->size & ~(size_t)BLOCK_FLAGS;
+}
+
+static inline Block *get_next(const Block *p_block) {
+	return (Block *)((uint8_t *)p_block + get_size(p_block));
+}
+
+static inline void *get_payload(Block *p_block) {
+	return (uint8_t *)p_block + 2 * HEADER_SIZE;
+}
+
+static inline Block *get_block(void *p_ptr) {
+	return (Block *)((uint8_t *)p_ptr - 2 * HEADER_SIZE);
+}
+
+// Returns 0 when the request can't be served.
+static inline size_t get_block_size(size_t p_size) {
+	if (p_size > MAX_BLOCK_SIZE) {
+		return 0;
+	}
+	size_t size = (p_size + HEADER_SIZE + ALIGNMENT - 1) & ~(size_t)(ALIGNMENT - 1);
+	return size < MIN_BLOCK_SIZE ? MIN_BLOCK_SIZE : size;
+}
+
+static inline bool owns(void *p_ptr) {
+	uintptr_t base = region_base.load(std::memory_order_relaxed);
+	return (uintptr_t)p_ptr - base < region_top - base;
+}
+
+/* Free lists, called with global_mutex held */
+
+static inline void get_list(size_t p_size, int &r_fl, int &r_sl) {
+	if (p_size < ((size_t)1 << LINEAR_SHIFT)) {
+		r_fl = 0;
+		r_sl = (int)(p_size >> 4);
+	} else {
+		int top_bit = 63 - __builtin_clzll(p_size);
+		r_fl = top_bit - LINEAR_SHIFT + 1;
+		r_sl = (int)(p_size >> (top_bit - SL_SHIFT)) - SL_COUNT;
+	}
+}
+
+// Lists are first in, first out: a block freed a while ago has had time for
+// its neighbours to be freed and merged, so it's reused before a recent one.
+static void insert_free(Block *p_block) {
+	int fl, sl;
+	get_list(get_size(p_block), fl, sl);
+	Block *tail = free_tails[fl][sl];
+	p_block->next_free = NULL;
+	p_block->prev_free = tail;
+	if (tail) {
+		tail->next_free = p_block;
+	} else {
+		free_lists[fl][sl] = p_block;
+	}
+	free_tails[fl][sl] = p_block;
+	fl_bitmap |= 1u << fl;
+	sl_bitmap[fl] |= 1u << sl;
+}
+
+static void remove_free(Block *p_block) {
+	int fl, sl;
+	get_list(get_size(p_block), fl, sl);
+	if (p_block->prev_free) {
+		p_block->prev_free->next_free = p_block->next_free;
+	} else {
+		free_lists[fl][sl] = p_block->next_free;
+		if (!p_block->next_free) {
+			sl_bitmap[fl] &= ~(1u << sl);
+			if (!sl_bitmap[fl]) {
+				fl_bitmap &= ~(1u << fl);
+			}
+		}
+	}
+	if (p_block->next_free) {
+		p_block->next_free->prev_free = p_block->prev_free;
+	} else {
+		free_tails[fl][sl] = p_block->prev_free;
+	}
+}
+
+// Returns the smallest of the first few blocks in a list that are at least
+// p_size large.
+static Block *find_best(Block *p_block, size_t p_size) {
+	Block *best = NULL;
+	for (int i = 0; p_block && i < FIT_SEARCH_LIMIT; i++) {
+		size_t size = get_size(p_block);
+		if (size >= p_size && (!best || size < get_size(best))) {
+			best = p_block;
+			if (size == p_size) {
+				break;
+			}
+		}
+		p_block = p_block->next_free;
+	}
+	return best;
+}
+
+// Any block in a list past the one p_size maps to is large enough. The start
+// of the list it maps to is checked first, which finds exact fits for small
+// sizes, where a list holds a single size.
+static Block *find_free(size_t p_size) {
+	int fl, sl;
+	get_list(p_size, fl, sl);
+	Block *block = find_best(free_lists[fl][sl], p_size);
+	if (block) {
+		return block;
+	}
+
+	uint32_t sl_map = sl + 1 < SL_COUNT ? sl_bitmap[fl] & (~0u << (sl + 1)) : 0;
+	if (!sl_map) {
+		uint32_t fl_map = fl + 1 < FL_COUNT ? fl_bitmap & (~0u << (fl + 1)) : 0;
+		if (!fl_map) {
+			return NULL;
+		}
+		fl = __builtin_ctz(fl_map);
+		sl_map = sl_bitmap[fl];
+	}
+	return find_best(free_lists[fl][__builtin_ctz(sl_map)], p_size);
+}
+
+// Marks a free block as free in its own header and in the next one's.
+static void set_free(Block *p_block, size_t p_size) {
+	p_block->size = p_size | BLOCK_FREE | (p_block->size & BLOCK_PREV_FREE);
+	Block *next = get_next(p_block);
+	next->prev_size = p_size;
+	next->size |= BLOCK_PREV_FREE;
+}
+
+// Gives the tail of a block past p_size back to the free lists, merging it with
+// the block after it when that one is free too.
+static void split(Block *p_block, size_t p_size) {
+	size_t size = get_size(p_block);
+	Block *next = get_next(p_block);
+	if (next->size & BLOCK_FREE) {
+		remove_free(next);
+		size += get_size(next);
+	} else if (size - p_size < MIN_BLOCK_SIZE) {
+		return;
+	}
+
+	p_block->size = p_size | (p_block->size & BLOCK_FLAGS);
+	Block *rest = get_next(p_block);
+	rest->size = 0;
+	set_free(rest, size - p_size);
+	insert_free(rest);
+}
+
+/* Region, called with global_mutex held */
+
+// Takes memory below the region from newlib's heap, and returns the free block
+// at the bottom of the region, at least p_size large.
+static Block *grow_region(size_t p_size) {
+	uintptr_t base = region_base.load(std::memory_order_relaxed);
+	Block *first = (Block *)base;
+	size_t first_free = (first->size & BLOCK_FREE) ? get_size(first) : 0;
+	size_t step = (p_size - (p_size < first_free ? p_size : first_free) + REGION_STEP - 1) & ~(REGION_STEP - 1);
+	if (step == 0) {
+		step = REGION_STEP;
+	}
+
+	lock_newlib();
+	bool available = (uintptr_t)get_newlib_top() + step <= base;
+	if (available) {
+		fake_heap_end -= step;
+	}
+	unlock_newlib();
+	if (!available) {
+		return NULL;
+	}
+
+	Block *block = (Block *)(base - step);
+	block->size = 0;
+	size_t size = step;
+	if (first_free) {
+		remove_free(first);
+		size += first_free;
+	}
+	set_free(block, size);
+	region_base.store(base - step, std::memory_order_relaxed);
+
+	uint64_t reserved = region_top - (base - step);
+	peak_reserved_bytes = reserved > peak_reserved_bytes ? reserved : peak_reserved_bytes;
+	return block;
+}
+
+// Hands most of a large free block at the bottom back to newlib. p_block is
+// not in the free lists yet.
+static void trim_region(Block *p_block) {
+	size_t size = get_size(p_block);
+	size_t trim = (size - REGION_STEP) & ~(REGION_STEP - 1);
+	Block *rest = (Block *)((uint8_t *)p_block + trim);
+	rest->size = 0;
+	set_free(rest, size - trim);
+	insert_free(rest);
+	region_base.store((uintptr_t)rest, std::memory_order_relaxed);
+
+	lock_newlib();
+	fake_heap_end += trim;
+	unlock_newlib();
+}
+
+static Block *arena_alloc(size_t p_size) {
+	Block *block = find_free(p_size);
+	if (block) {
+		remove_free(block);
+	} else {
+		block = grow_region(p_size);
+		if (!block) {
+			return NULL;
+		}
+	}
+
+	// The bottom block is handed out from its top end, so what's left of it
+	// stays at the bottom where it can grow or be trimmed.
+	size_t size = get_size(block);
+	if ((uintptr_t)block == region_base.load(std::memory_order_relaxed) && size - p_size >= MIN_BLOCK_SIZE) {
+		set_free(block, size - p_size);
+		insert_free(block);
+		Block *top = get_next(block);
+		top->size = p_size | BLOCK_PREV_FREE;
+		get_next(top)->size &= ~(size_t)BLOCK_PREV_FREE;
+		used_bytes += p_size;
+		return top;
+	}
+
+	block->size &= ~(size_t)BLOCK_FREE;
+	get_next(block)->size &= ~(size_t)BLOCK_PREV_FREE;
+	split(block, p_size);
+	used_bytes += get_size(block);
+	return block;
+}
+
+static void arena_free(Block *p_block) {
+	size_t size = get_size(p_block);
+	used_bytes -= size;
+
+	Block *next = get_next(p_block);
+	if (next->size & BLOCK_FREE) {
+		remove_free(next);
+		size += get_size(next);
+	}
+	if (p_block->size & BLOCK_PREV_FREE) {
+		Block *prev = (Block *)((uint8_t *)p_block - p_block->prev_size);
+		remove_free(prev);
+		size += get_size(prev);
+		p_block = prev;
+	}
+	set_free(p_block, size);
+
+	if ((uintptr_t)p_block == region_base.load(std::memory_order_relaxed) && size >= REGION_TRIM) {
+		trim_region(p_block);
+	} else {
+		insert_free(p_block);
+	}
+}
+
+// Grows or shrinks a live block where it is, when the block after it allows.
+static bool arena_resize(Block *p_block, size_t p_size) {
+	size_t size = get_size(p_block);
+	if (p_size > size) {
+		Block *next = get_next(p_block);
+		if (!(next->size & BLOCK_FREE) || size + get_size(next) < p_size) {
+			return false;
+		}
+		remove_free(next);
+		p_block->size = (size + get_size(next)) | (p_block->size & BLOCK_FLAGS);
+		get_next(p_block)->size &= ~(size_t)BLOCK_PREV_FREE;
+	}
+
+	used_bytes -= size;
+	split(p_block, p_size);
+	used_bytes += get_size(p_block);
+	return true;
+}
+
+// The first malloc happens during libnx startup, before any other thread exists.
+static void initialize() {
+	mutexInit(&global_mutex);
+
+	// A zero-sized block at the top stops merges at the end of the region.
+	region_top = (uintptr_t)fake_heap_end & ~(uintptr_t)(ALIGNMENT - 1);
+	region_base.store(region_top - ALIGNMENT, std::memory_order_relaxed);
+	Block *end = (Block *)(region_top - ALIGNMENT);
+	end->size = 0;
+	fake_heap_end = (char *)(region_top - ALIGNMENT);
+
+	pthread_key_create(&cache_key, release_thread_cache);
+	initialized = true;
+}
+
+/* Thread caches */
+
+static void flush_cache(ThreadCache *p_cache, int p_class, int p_keep) {
+	mutexLock(&global_mutex);
+	while (p_cache->count[p_class] > p_keep) {
+		Block *block = p_cache->head[p_class];
+		p_cache->head[p_class] = block->next_free;
+		p_cache->count[p_class]--;
+		arena_free(block);
+	}
+	mutexUnlock(&global_mutex);
+}
+
+static void release_thread_cache(void *p_cache) {
+	ThreadCache *tc = (ThreadCache *)p_cache;
+	for (int c = 0; c < CACHE_CLASS_COUNT; c++) {
+		if (tc->count[c]) {
+			flush_cache(tc, c, 0);
+		}
+	}
+
+	// Other destructors of this thread may still allocate, they go to the arena
+	// from here on instead of getting a new cache nothing would release.
+	thread_cache = NULL;
+	cache_released = true;
+	mutexLock(&global_mutex);
+	arena_free(get_block(tc));
+	mutexUnlock(&global_mutex);
+}
+
+static ThreadCache *get_thread_cache() {
+	if (thread_cache || creating_cache || cache_released) {
+		return thread_cache;
+	}
+
+	// pthread may allocate while registering the destructor, don't recurse into here.
+	creating_cache = true;
+	mutexLock(&global_mutex);
+	Block *block = arena_alloc(get_block_size(sizeof(ThreadCache)));
+	mutexUnlock(&global_mutex);
+	ThreadCache *tc = NULL;
+	if (block) {
+		tc = (ThreadCache *)get_payload(block);
+		memset(tc, 0, sizeof(ThreadCache));
+		pthread_setspecific(cache_key, tc);
+	}
+	thread_cache = tc;
+	creating_cache = false;
+	return tc;
+}
+
+static void *arena_malloc(size_t p_size) {
+	if (!initialized) {
+		initialize();
+	}
+	size_t size = get_block_size(p_size);
+	if (!size) {
+		return NULL;
+	}
+
+	if (size <= MAX_CACHED_SIZE) {
+		ThreadCache *tc = get_thread_cache();
+		int c = (int)(size >> 4);
+		if (tc && tc->head[c]) {
+			Block *block = tc->head[c];
+			tc->head[c] = block->next_free;
+			tc->count[c]--;
+			return get_payload(block);
+		}
+	}
+
+	mutexLock(&global_mutex);
+	Block *block = arena_alloc(size);
+	mutexUnlock(&global_mutex);
+	return block ? get_payload(block) : NULL;
+}
+
+static void arena_release(void *p_ptr) {
+	Block *block = get_block(p_ptr);
+	size_t size = get_size(block);
+
+	if (size <= MAX_CACHED_SIZE) {
+		ThreadCache *tc = get_thread_cache();
+		if (tc) {
+			int c = (int)(size >> 4);
+			if (tc->count[c] == CACHE_LIMIT) {
+				flush_cache(tc, c, CACHE_LIMIT / 2);
+			}
+			block->next_free = tc->head[c];
+			tc->head[c] = block;
+			tc->count[c]++;
+			return;
+		}
+	}
+
+	mutexLock(&global_mutex);
+	arena_free(block);
+	mutexUnlock(&global_mutex);
+}
+
+static void *arena_realloc(void *p_ptr, size_t p_size) {
+	size_t size = get_block_size(p_size);
+	if (!size) {
+		return NULL;
+	}
+	Block *block = get_block(p_ptr);
+	size_t current = get_size(block);
+	if (size <= current && current - size < MIN_BLOCK_SIZE) {
+		return p_ptr;
+	}
+
+	mutexLock(&global_mutex);
+	bool resized = arena_resize(block, size);
+	mutexUnlock(&global_mutex);
+	if (resized) {
+		return p_ptr;
+	}
+
+	void *ptr = __wrap_malloc(p_size);
+	if (ptr) {
+		memcpy(ptr, p_ptr, p_size < current - HEADER_SIZE ? p_size : current - HEADER_SIZE);
+		arena_release(p_ptr);
+	}
+	return ptr;
+}
+
+void *__wrap_malloc(size_t p_size) {
+	void *ptr = arena_malloc(p_size);
+	// The region ran into newlib's heap, which may still have room in between.
+	return ptr ? ptr : __real_malloc(p_size);
+}
+
+void __wrap_free(void *p_ptr) {
+	if (!p_ptr) {
+		return;
+	}
+	if (owns(p_ptr)) {
+		arena_release(p_ptr);
+	} else {
+		// Allocated by newlib, either forwarded by us or from its own internals.
+		__real_free(p_ptr);
+	}
+}
+
+void *__wrap_calloc(size_t p_count, size_t p_size) {
+	size_t size;
+	if (__builtin_mul_overflow(p_count, p_size, &size)) {
+		return NULL;
+	}
+	void *ptr = arena_malloc(size);
+	if (!ptr) {
+		return __real_calloc(p_count, p_size);
+	}
+	memset(ptr, 0, size);
+	return ptr;
+}
+
+void *__wrap_realloc(void *p_ptr, size_t p_size) {
+	if (!p_ptr) {
+		return __wrap_malloc(p_size);
+	}
+	if (!owns(p_ptr)) {
+		return __real_realloc(p_ptr, p_size);
+	}
+	return arena_realloc(p_ptr, p_size);
+}
+
+size_t __wrap_malloc_usable_size(void *p_ptr) {
+	if (!p_ptr) {
+		return 0;
+	}
+	return owns(p_ptr) ? get_size(get_block(p_ptr)) - HEADER_SIZE : __real_malloc_usable_size(p_ptr);
+}
+
+#ifdef __SWITCH__
+void __wrap__free_r(struct _reent *p_reent, void *p_ptr) {
+	if (p_ptr && owns(p_ptr)) {
+		arena_release(p_ptr);
+	} else {
+		__real__free_r(p_reent, p_ptr);
+	}
+}
+
+void *__wrap__realloc_r(struct _reent *p_reent, void *p_ptr, size_t p_size) {
+	if (p_ptr && owns(p_ptr)) {
+		return arena_realloc(p_ptr, p_size);
+	}
+	return __real__realloc_r(p_reent, p_ptr, p_size);
+}
+
+size_t __wrap__malloc_usable_size_r(struct _reent *p_reent, void *p_ptr) {
+	if (p_ptr && owns(p_ptr)) {
+		return get_size(get_block(p_ptr)) - HEADER_SIZE;
+	}
+	return __real__malloc_usable_size_r(p_reent, p_ptr);
+}
+#endif
+
+bool AllocatorSwitch::is_enabled() {
+	return true;
+}
+
+AllocatorSwitch::Stats AllocatorSwitch::get_stats() {
+	Stats stats = {};
+	if (!initialized) {
+		return stats;
+	}
+	mutexLock(&global_mutex);
+	stats.reserved_bytes = region_top - region_base.load(std::memory_order_relaxed);
+	stats.used_bytes = used_bytes;
+	stats.peak_reserved_bytes = peak_reserved_bytes;
+	mutexUnlock(&global_mutex);
+	return stats;
+}
+
+#else
+
+bool AllocatorSwitch::is_enabled() {
+	return false;
+}
+
+AllocatorSwitch::Stats AllocatorSwitch::get_stats() {
+	Stats stats = {};
+	return stats;
+}
+
+#endif // SWITCH_ARENA_ALLOCATOR_ENABLED
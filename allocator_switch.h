@@ -0,0 +1,60 @@
+/**************************************************************************/
+/*  allocator_switch.h                                                    */
+/**************************************************************************/
+/*                         This file is part of:                          */
+/*                             GODOT ENGINE                               */
+/*                        https://godotengine.org                         */
+/**************************************************************************/
+/* Copyright (c) 2014-present Godot Engine contributors (see AUTHORS.md). */
+/* Copyright (c) 2007-2014 Juan Linietsky, Ariel Manzur.                  */
+/*                                                                        */
+/* Permission is hereby granted, free of charge, to any person obtaining  */
+/* a copy of this software and associated documentation files (the        */
+/* "Software"), to deal in the Software without restriction, including    */
+/* without limitation the rights to use, copy, modify, merge, publish,    */
+/* distribute, sublicense, and/or sell copies of the Software, and to     */
+/* permit persons to whom the Software is furnished to do so, subject to  */
+/* the following conditions:                                              */
+/*                                                                        */
+/* The above copyright notice and this permission notice shall be         */
+/* included in all copies or substantial portions of the Software.        */
+/*                                                                        */
+/* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,        */
+/* EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF     */
+/* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. */
+/* IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY   */
+/* CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,   */
+/* TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE      */
+/* SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.                 */
+/**************************************************************************/
+
+#ifndef ALLOCATOR_SWITCH_H
+#define ALLOCATOR_SWITCH_H
+
+#include <stdint.h>
+
+// Heap allocator enabled with the `arena_allocator` build option. malloc, free,
+// calloc and realloc are wrapped at link time, so it sits under
+// Memory::alloc_static and everything else that uses the C heap; the newlib
+// entry points that take a pointer are wrapped too.
+// All sizes come from one region taken from the top of newlib's heap as it
+// grows, and given back when its bottom empties out. Blocks are found in
+// segregated free lists and merged with their neighbours when freed. Small
+// blocks are cached per thread by size class, so most allocations on worker
+// threads don't take the lock.
+// There are no per-class spans: a block that outlives a level would keep its
+// whole span, which only that size could reuse.
+// tests/bench_allocator_switch.cpp replays allocation traces against newlib.
+class AllocatorSwitch {
+public:
+	struct Stats {
+		uint64_t reserved_bytes; // region taken from newlib
+		uint64_t used_bytes; // in blocks handed out, headers and thread caches included
+		uint64_t peak_reserved_bytes;
+	};
+
+	static bool is_enabled();
+	static Stats get_stats();
+};
+
+#endif // ALLOCATOR_SWITCH_H
@@ -36,6 +36,7 @@
 
 #include "core/engine.h"
 #include "core/os/keyboard.h"
+#include "core/os/os.h"
 
 // === === ===
 // === API ===
@@ -68,6 +69,7 @@ NintendoSwitch *NintendoSwitch::get_singleton() {
 NintendoSwitch::NintendoSwitch() {
 	ERR_FAIL_COND_MSG(singleton != nullptr, "NintendoSwitch singleton already exists.");
 	singleton = this;
+	power_saving_tier = POWER_SAVING_NONE;
 #ifdef HORIZON_ENABLED
 	swkbdInlineCreate(&inline_keyboard);
 #endif // HORIZON_ENABLED
@@ -75,6 +77,12 @@ NintendoSwitch::NintendoSwitch() {
 
 void NintendoSwitch::_bind_methods() {
 	ClassDB::bind_method(D_METHOD("show_virtual_keyboard", "existing_text", "type"), &NintendoSwitch::show_virtual_keyboard, DEFVAL(""), DEFVAL(NORMAL_KEYBOARD));
+	ClassDB::bind_method(D_METHOD("get_datetime", "utc"), &NintendoSwitch::get_datetime, DEFVAL(false));
+	ClassDB::bind_method(D_METHOD("get_power_saving_tier"), &NintendoSwitch::get_power_saving_tier);
+	ClassDB::bind_method(D_METHOD("get_memory_info"), &NintendoSwitch::get_memory_info);
+	ClassDB::bind_method(D_METHOD("get_frame_timing"), &NintendoSwitch::get_frame_timing);
+
+	ADD_SIGNAL(MethodInfo("power_saving_tier_changed", PropertyInfo(Variant::INT, "tier")));
 
 	BIND_ENUM_CONSTANT(NORMAL_KEYBOARD)
 	BIND_ENUM_CONSTANT(NUMPAD_KEYBOARD)
@@ -84,6 +92,10 @@ void NintendoSwitch::_bind_methods() {
 	BIND_ENUM_CONSTANT(TRADITIONAL_CHINESE_KEYBOARD)
 	BIND_ENUM_CONSTANT(KOREAN_KEYBOARD)
 	BIND_ENUM_CONSTANT(ALL_LANGUAGES_KEYBOARD)
+
+	BIND_ENUM_CONSTANT(POWER_SAVING_NONE)
+	BIND_ENUM_CONSTANT(POWER_SAVING_LOW)
+	BIND_ENUM_CONSTANT(POWER_SAVING_CRITICAL)
 }
 
 #ifdef HORIZON_ENABLED
@@ -174,6 +186,75 @@ bool NintendoSwitch::is_virtual_keyboard_open() {
 	return g_swkbd_open;
 }
 
+Dictionary NintendoSwitch::get_datetime(bool p_utc) const {
+	OS::Date date;
+	OS::Time time;
+#ifdef HORIZON_ENABLED
+	OS_Switch::get_singleton()->get_date_time(p_utc, date, time);
+#else
+	date = OS::get_singleton()->get_date(p_utc);
+	time = OS::get_singleton()->get_time(p_utc);
+#endif // HORIZON_ENABLED
+
+	// Same keys as OS.get_datetime().
+	Dictionary dated;
+	dated["year"] = date.year;
+	dated["month"] = date.month;
+	dated["day"] = date.day;
+	dated["weekday"] = date.weekday;
+	dated["dst"] = date.dst;
+	dated["hour"] = time.hour;
+	dated["minute"] = time.min;
+	dated["second"] = time.sec;
+	return dated;
+}
+
+Dictionary NintendoSwitch::get_memory_info() const {
+	Dictionary info;
+#ifdef HORIZON_ENABLED
+	OS_Switch::MemoryInfo mem = OS_Switch::get_singleton()->get_memory_info();
+	info["physical_total"] = mem.physical_total;
+	info["physical_used"] = mem.physical_used;
+	info["heap_total"] = mem.heap_total;
+	info["heap_used"] = mem.heap_used;
+	info["arena_reserved"] = mem.arena_reserved;
+	info["arena_used"] = mem.arena_used;
+#else
+	info["physical_used"] = OS::get_singleton()->get_static_memory_usage();
+#endif // HORIZON_ENABLED
+	info["peak_used"] = OS::get_singleton()->get_static_memory_peak_usage();
+	return info;
+}
+
+Dictionary NintendoSwitch::get_frame_timing() const {
+	Dictionary timing;
+#ifdef HORIZON_ENABLED
+	OS_Switch::FrameTiming frame = OS_Switch::get_singleton()->get_frame_timing();
+	timing["swap_chain_depth"] = frame.swap_chain_depth;
+	timing["present_queue_depth"] = frame.present_queue_depth;
+	timing["cpu_frame_usec"] = frame.cpu_frame_usec;
+	timing["present_wait_usec"] = frame.present_wait_usec;
+	timing["gpu_timing_supported"] = frame.gpu_timing_supported;
+	if (frame.gpu_timing_supported) {
+		timing["gpu_frame_usec"] = frame.gpu_frame_usec;
+		timing["gpu_frame_average_usec"] = frame.gpu_frame_average_usec;
+	}
+#endif // HORIZON_ENABLED
+	return timing;
+}
+
+void NintendoSwitch::set_power_saving_tier(PowerSavingTier p_tier) {
+	if (power_saving_tier == p_tier) {
+		return;
+	}
+	power_saving_tier = p_tier;
+	emit_signal("power_saving_tier_changed", p_tier);
+}
+
+NintendoSwitch::PowerSavingTier NintendoSwitch::get_power_saving_tier() const {
+	return power_saving_tier;
+}
+
 void NintendoSwitch::cleanup() {
 #ifdef HORIZON_ENABLED
 	swkbdInlineClose(&inline_keyboard);
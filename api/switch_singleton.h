@@ -54,6 +54,12 @@ public:
 		ALL_LANGUAGES_KEYBOARD = 8,
 	};
 
+	enum PowerSavingTier {
+		POWER_SAVING_NONE = 0,
+		POWER_SAVING_LOW = 1,
+		POWER_SAVING_CRITICAL = 2,
+	};
+
 	int g_eat_string_events = 0;
 #ifdef HORIZON_ENABLED
 	SwkbdInline inline_keyboard;
@@ -62,6 +68,8 @@ public:
 protected:
 	static NintendoSwitch *singleton;
 
+	PowerSavingTier power_saving_tier;
+
 	static void _bind_methods();
 
 public:
@@ -73,12 +81,20 @@ public:
 	void hide_virtual_keyboard();
 	bool is_virtual_keyboard_open();
 
+	Dictionary get_datetime(bool p_utc = false) const;
+	Dictionary get_memory_info() const;
+	Dictionary get_frame_timing() const;
+
+	void set_power_saving_tier(PowerSavingTier p_tier);
+	PowerSavingTier get_power_saving_tier() const;
+
 	void cleanup();
 
 	NintendoSwitch();
 };
 
 VARIANT_ENUM_CAST(NintendoSwitch::SoftwareKeyboardType);
+VARIANT_ENUM_CAST(NintendoSwitch::PowerSavingTier);
 
 #endif // MODULE_MONO_ENABLED
 
@@ -29,19 +29,109 @@
 /**************************************************************************/
 
 #include "context_gl_switch_egl.h"
+#include "logger_switch.h"
+#include "splash_switch.h"
 #include "switch_wrapper.h"
-#include <stdio.h>
 
-#define ENABLE_NXLINK
-#ifndef ENABLE_NXLINK
-#define TRACE(fmt, ...) ((void)0)
-#else
-#include <unistd.h>
-#define TRACE(fmt, ...) printf("%s: " fmt "\n", __PRETTY_FUNCTION__, ##__VA_ARGS__)
-#endif
+#include <string.h>
+
+static const EGLint gles3ContextAttributeList[] = {
+	EGL_CONTEXT_CLIENT_VERSION, 3, // request OpenGL ES 3.x
+	EGL_NONE
+};
+
+static const EGLint gles2ContextAttributeList[] = {
+	EGL_CONTEXT_CLIENT_VERSION, 2, // request OpenGL ES 2.0
+	EGL_NONE
+};
 
 ContextGLSwitchEGL::ContextGLSwitchEGL(bool gles3_context) {
 	this->gles3_context = gles3_context;
+	display = NULL;
+	config = NULL;
+	context = NULL;
+	surface = NULL;
+	msaa_samples = 0;
+	depth_bits = 24;
+	stencil_bits = 8;
+	srgb = false;
+	frames_in_flight = MAX_FRAMES_IN_FLIGHT;
+	frame_fence_count = 0;
+	present_queue_depth.store(0);
+	frame_start_tick = 0;
+	context_lost.store(false);
+	cpu_frame_usec.store(0);
+	present_wait_usec.store(0);
+	egl_create_sync = NULL;
+	egl_client_wait_sync = NULL;
+	egl_destroy_sync = NULL;
+	egl_get_sync_attrib = NULL;
+}
+
+// Lower is better. Missing samples or depth/stencil bits cost the most, extra
+// ones cost a little, since they are bandwidth spent for nothing.
+static int _score_config(EGLDisplay p_display, EGLConfig p_config, int p_samples, int p_depth, int p_stencil) {
+	EGLint samples = 0, depth = 0, stencil = 0, alpha = 0;
+	eglGetConfigAttrib(p_display, p_config, EGL_SAMPLES, &samples);
+	eglGetConfigAttrib(p_display, p_config, EGL_DEPTH_SIZE, &depth);
+	eglGetConfigAttrib(p_display, p_config, EGL_STENCIL_SIZE, &stencil);
+	eglGetConfigAttrib(p_display, p_config, EGL_ALPHA_SIZE, &alpha);
+
+	int score = 0;
+	score += samples < p_samples ? (p_samples - samples) * 100 : (samples - p_samples) * 20;
+	score += depth < p_depth ? (p_depth - depth) * 10 : (depth - p_depth);
+	score += stencil < p_stencil ? (p_stencil - stencil) * 10 : (stencil - p_stencil);
+	score += alpha != 8 ? 5 : 0;
+	return score;
+}
+
+EGLConfig ContextGLSwitchEGL::_choose_config() {
+	const EGLint attributeList[] = {
+		EGL_RED_SIZE, 8,
+		EGL_GREEN_SIZE, 8,
+		EGL_BLUE_SIZE, 8,
+		EGL_SURFACE_TYPE, EGL_WINDOW_BIT,
+		EGL_RENDERABLE_TYPE, gles3_context ? EGL_OPENGL_ES3_BIT_KHR : EGL_OPENGL_ES2_BIT,
+		EGL_NONE
+	};
+
+	EGLint numConfigs = 0;
+	eglChooseConfig(display, attributeList, NULL, 0, &numConfigs);
+	if (numConfigs <= 0) {
+		return NULL;
+	}
+
+	Vector<EGLConfig> configs;
+	configs.resize(numConfigs);
+	eglChooseConfig(display, attributeList, configs.ptrw(), numConfigs, &numConfigs);
+
+	EGLConfig best = NULL;
+	int best_score = 0;
+	for (int i = 0; i < numConfigs; i++) {
+		// eglChooseConfig treats color sizes as minimums, only take exact RGB8.
+		EGLint red = 0, green = 0, blue = 0;
+		eglGetConfigAttrib(display, configs[i], EGL_RED_SIZE, &red);
+		eglGetConfigAttrib(display, configs[i], EGL_GREEN_SIZE, &green);
+		eglGetConfigAttrib(display, configs[i], EGL_BLUE_SIZE, &blue);
+		if (red != 8 || green != 8 || blue != 8) {
+			continue;
+		}
+
+		int score = _score_config(display, configs[i], msaa_samples, depth_bits, stencil_bits);
+		if (!best || score < best_score) {
+			best = configs[i];
+			best_score = score;
+		}
+	}
+
+	if (best) {
+		EGLint samples = 0, depth = 0, stencil = 0;
+		eglGetConfigAttrib(display, best, EGL_SAMPLES, &samples);
+		eglGetConfigAttrib(display, best, EGL_DEPTH_SIZE, &depth);
+		eglGetConfigAttrib(display, best, EGL_STENCIL_SIZE, &stencil);
+		TRACE("Picked config with %d samples, depth %d, stencil %d (asked %d, %d, %d)", samples, depth, stencil, msaa_samples, depth_bits, stencil_bits);
+	}
+	return best;
 }
 
 ContextGLSwitchEGL::~ContextGLSwitchEGL() {
@@ -49,86 +139,130 @@ ContextGLSwitchEGL::~ContextGLSwitchEGL() {
 }
 
 Error ContextGLSwitchEGL::initialize() {
-	// Connect to the EGL default display
-	display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+	// The display is kept when falling back to GLES2, see fallback_to_gles2()
 	if (!display) {
-		TRACE("Could not connect to display! error: %d", eglGetError());
-		goto _fail0;
-	}
+		// Connect to the EGL default display
+		display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+		if (!display) {
+			TRACE("Could not connect to display! error: %d", eglGetError());
+			goto _fail0;
+		}
 
-	// Initialize the EGL display connection
-	eglInitialize(display, NULL, NULL);
+		// Initialize the EGL display connection
+		eglInitialize(display, NULL, NULL);
+	}
 
 	// Get an appropriate EGL framebuffer configuration
-	EGLConfig config;
-	EGLint numConfigs;
-	static const EGLint attributeList[] = {
-		EGL_RED_SIZE, 8,
-		EGL_GREEN_SIZE, 8,
-		EGL_BLUE_SIZE, 8,
-		EGL_ALPHA_SIZE, 8,
-		EGL_DEPTH_SIZE, 24,
-		EGL_STENCIL_SIZE, 8,
-		EGL_NONE
-	};
-	eglChooseConfig(display, attributeList, &config, 1, &numConfigs);
-	if (numConfigs == 0) {
+	config = _choose_config();
+	if (!config) {
 		TRACE("No config found! error: %d", eglGetError());
-		goto _fail1;
+		goto _fail0;
 	}
 
+	// Take the window over from the boot splash, if it's still up
+	splash_switch_close();
+
 	// Create an EGL window surface
-	surface = eglCreateWindowSurface(display, config, nwindowGetDefault(), NULL);
+	{
+		EGLint surfaceAttributeList[] = { EGL_NONE, EGL_NONE, EGL_NONE };
+		if (srgb) {
+			const char *extensions = eglQueryString(display, EGL_EXTENSIONS);
+			if (extensions && strstr(extensions, "EGL_KHR_gl_colorspace")) {
+				surfaceAttributeList[0] = EGL_GL_COLORSPACE_KHR;
+				surfaceAttributeList[1] = EGL_GL_COLORSPACE_SRGB_KHR;
+			} else {
+				srgb = false;
+			}
+		}
+		surface = eglCreateWindowSurface(display, config, nwindowGetDefault(), surfaceAttributeList);
+	}
 	if (!surface) {
 		TRACE("Surface creation failed! error: %d", eglGetError());
-		goto _fail1;
+		goto _fail0;
 	}
 
-	static const EGLint contextAttributeList[] = {
-		EGL_CONTEXT_CLIENT_VERSION, 3, // request OpenGL ES 3.x
-		EGL_NONE
-	};
-
 	// Create an EGL rendering context
-	context = eglCreateContext(display, config, EGL_NO_CONTEXT, contextAttributeList);
+	context = eglCreateContext(display, config, EGL_NO_CONTEXT, gles3_context ? gles3ContextAttributeList : gles2ContextAttributeList);
 	if (!context) {
 		TRACE("Context creation failed! error: %d", eglGetError());
-		goto _fail2;
+		goto _fail1;
 	}
 
 	// Connect the context to the surface
 	eglMakeCurrent(display, surface, surface, context);
+
+	{
+		const char *extensions = eglQueryString(display, EGL_EXTENSIONS);
+		if (extensions && strstr(extensions, "EGL_KHR_fence_sync")) {
+			egl_create_sync = (PFNEGLCREATESYNCKHRPROC)eglGetProcAddress("eglCreateSyncKHR");
+			egl_client_wait_sync = (PFNEGLCLIENTWAITSYNCKHRPROC)eglGetProcAddress("eglClientWaitSyncKHR");
+			egl_destroy_sync = (PFNEGLDESTROYSYNCKHRPROC)eglGetProcAddress("eglDestroySyncKHR");
+			egl_get_sync_attrib = (PFNEGLGETSYNCATTRIBKHRPROC)eglGetProcAddress("eglGetSyncAttribKHR");
+		}
+		if (!egl_create_sync || !egl_client_wait_sync || !egl_destroy_sync || !egl_get_sync_attrib) {
+			TRACE("EGL_KHR_fence_sync unavailable, the swap chain depth is up to the driver");
+			egl_create_sync = NULL;
+		}
+	}
+
+	gpu_timer.initialize();
+	frame_start_tick = armGetSystemTick();
 	return OK;
 
-_fail2:
+_fail1:
 	eglDestroySurface(display, surface);
 	surface = NULL;
-_fail1:
-	eglTerminate(display);
-	display = NULL;
 _fail0:
 	return ERR_UNCONFIGURED;
 }
 
+Error ContextGLSwitchEGL::fallback_to_gles2() {
+	_destroy_context();
+	gles3_context = false;
+	return initialize();
+}
+
+void ContextGLSwitchEGL::_destroy_context() {
+	_release_frame_fences();
+	gpu_timer.reset();
+	eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+	if (context) {
+		eglDestroyContext(display, context);
+		context = NULL;
+	}
+	if (surface) {
+		eglDestroySurface(display, surface);
+		surface = NULL;
+	}
+}
+
 void ContextGLSwitchEGL::cleanup() {
 	if (display) {
-		eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
-		if (context) {
-			eglDestroyContext(display, context);
-			context = NULL;
-		}
-		if (surface) {
-			eglDestroySurface(display, surface);
-			surface = NULL;
-		}
+		_destroy_context();
 		eglTerminate(display);
 		display = NULL;
 	}
 }
 
-void ContextGLSwitchEGL::reset() {
-	cleanup();
-	initialize();
+EGLContext ContextGLSwitchEGL::create_shared_context() {
+	EGLContext shared = eglCreateContext(display, config, context, gles3_context ? gles3ContextAttributeList : gles2ContextAttributeList);
+	if (!shared) {
+		TRACE("Shared context creation failed! error: %d", eglGetError());
+		return EGL_NO_CONTEXT;
+	}
+	return shared;
+}
+
+bool ContextGLSwitchEGL::make_shared_current(EGLContext p_context) {
+	// Relies on EGL_KHR_surfaceless_context, which Mesa provides.
+	return eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, p_context) == EGL_TRUE;
+}
+
+void ContextGLSwitchEGL::destroy_shared_context(EGLContext p_context) {
+	if (eglGetCurrentContext() == p_context) {
+		eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+	}
+	eglDestroyContext(display, p_context);
 }
 
 void ContextGLSwitchEGL::release_current() {
@@ -148,5 +282,57 @@ int ContextGLSwitchEGL::get_window_height() {
 }
 
 void ContextGLSwitchEGL::swap_buffers() {
-	eglSwapBuffers(display, surface);
+	uint64_t swap_tick = armGetSystemTick();
+	cpu_frame_usec.store(armTicksToNs(swap_tick - frame_start_tick) / 1000, std::memory_order_relaxed);
+
+	gpu_timer.end_frame();
+	if (eglSwapBuffers(display, surface) != EGL_TRUE && eglGetError() == EGL_CONTEXT_LOST) {
+		// Every object the rasterizer holds is gone, OS_Switch::run() takes it from here
+		context_lost.store(true);
+	}
+	_limit_frames_in_flight();
+	gpu_timer.begin_frame();
+
+	frame_start_tick = armGetSystemTick();
+	present_wait_usec.store(armTicksToNs(frame_start_tick - swap_tick) / 1000, std::memory_order_relaxed);
+}
+
+void ContextGLSwitchEGL::_limit_frames_in_flight() {
+	if (!egl_create_sync) {
+		return;
+	}
+
+	EGLSyncKHR fence = egl_create_sync(display, EGL_SYNC_FENCE_KHR, NULL);
+	if (fence == EGL_NO_SYNC_KHR) {
+		return;
+	}
+	frame_fences[frame_fence_count++] = fence;
+
+	// Block on the oldest frames until no more than frames_in_flight are queued
+	while (frame_fence_count > frames_in_flight) {
+		egl_client_wait_sync(display, frame_fences[0], EGL_SYNC_FLUSH_COMMANDS_BIT_KHR, EGL_FOREVER_KHR);
+		egl_destroy_sync(display, frame_fences[0]);
+		frame_fence_count--;
+		for (int i = 0; i < frame_fence_count; i++) {
+			frame_fences[i] = frame_fences[i + 1];
+		}
+	}
+
+	int pending = 0;
+	for (int i = 0; i < frame_fence_count; i++) {
+		EGLint status = EGL_SIGNALED_KHR;
+		egl_get_sync_attrib(display, frame_fences[i], EGL_SYNC_STATUS_KHR, &status);
+		if (status != EGL_SIGNALED_KHR) {
+			pending++;
+		}
+	}
+	present_queue_depth.store(pending, std::memory_order_relaxed);
+}
+
+void ContextGLSwitchEGL::_release_frame_fences() {
+	for (int i = 0; i < frame_fence_count; i++) {
+		egl_destroy_sync(display, frame_fences[i]);
+	}
+	frame_fence_count = 0;
+	present_queue_depth.store(0, std::memory_order_relaxed);
 }
@@ -30,13 +30,50 @@
 
 #pragma once
 #include "core/os/os.h"
+#include "gpu_timer_switch.h"
 #include <EGL/egl.h> // EGL library
+#include <EGL/eglext.h>
+#include <atomic>
 
 class ContextGLSwitchEGL {
+	enum {
+		MAX_FRAMES_IN_FLIGHT = 2,
+	};
+
 	bool gles3_context;
 	bool vsync;
 
+	// Requested window framebuffer, the closest config the driver offers is used.
+	int msaa_samples;
+	int depth_bits;
+	int stencil_bits;
+	bool srgb;
+
+	// Frames the CPU may queue ahead of the GPU, 1 for double buffering and 2 for
+	// triple. Enforced with a fence per swap, the NWindow's buffer count is fixed.
+	int frames_in_flight;
+	EGLSyncKHR frame_fences[MAX_FRAMES_IN_FLIGHT + 1];
+	int frame_fence_count;
+	std::atomic<int> present_queue_depth;
+
+	GPUTimerSwitch gpu_timer;
+	uint64_t frame_start_tick;
+	std::atomic<uint32_t> cpu_frame_usec; // render thread work between two swaps
+	std::atomic<uint32_t> present_wait_usec; // time spent in the swap and the frame limiter
+	std::atomic<bool> context_lost;
+
+	PFNEGLCREATESYNCKHRPROC egl_create_sync;
+	PFNEGLCLIENTWAITSYNCKHRPROC egl_client_wait_sync;
+	PFNEGLDESTROYSYNCKHRPROC egl_destroy_sync;
+	PFNEGLGETSYNCATTRIBKHRPROC egl_get_sync_attrib;
+
+	EGLConfig _choose_config();
+	void _destroy_context();
+	void _limit_frames_in_flight();
+	void _release_frame_fences();
+
 	EGLDisplay display;
+	EGLConfig config;
 	EGLContext context;
 	EGLSurface surface;
 
@@ -51,10 +88,39 @@ public:
 	void set_use_vsync(bool use) { vsync = use; }
 	bool is_using_vsync() const { return vsync; }
 
+	// Only take effect on the next initialize().
+	void set_msaa_samples(int p_samples) { msaa_samples = p_samples; }
+	void set_depth_stencil_bits(int p_depth, int p_stencil) {
+		depth_bits = p_depth;
+		stencil_bits = p_stencil;
+	}
+	void set_use_srgb(bool p_srgb) { srgb = p_srgb; }
+	bool is_using_srgb() const { return srgb; }
+
+	void set_swap_chain_depth(int p_depth) { frames_in_flight = CLAMP(p_depth - 1, 1, (int)MAX_FRAMES_IN_FLIGHT); }
+	int get_swap_chain_depth() const { return frames_in_flight + 1; }
+	// Frames swapped but not yet finished by the GPU, as of the last swap.
+	int get_present_queue_depth() const { return present_queue_depth.load(std::memory_order_relaxed); }
+
+	uint32_t get_cpu_frame_usec() const { return cpu_frame_usec.load(std::memory_order_relaxed); }
+	uint32_t get_present_wait_usec() const { return present_wait_usec.load(std::memory_order_relaxed); }
+	const GPUTimerSwitch &get_gpu_timer() const { return gpu_timer; }
+
+	// Secondary contexts sharing objects with the main one, for worker threads.
+	// They have no surface and are made current with make_shared_current().
+	EGLContext create_shared_context();
+	bool make_shared_current(EGLContext p_context);
+	void destroy_shared_context(EGLContext p_context);
+
 	virtual Error initialize();
-	void reset();
 	void cleanup();
 
+	bool is_context_lost() const { return context_lost.load(); }
+
+	// Replaces a GLES3 context with a GLES2 one, keeping the display up.
+	Error fallback_to_gles2();
+	bool is_gles3() const { return gles3_context; }
+
 	ContextGLSwitchEGL(bool gles3);
 	virtual ~ContextGLSwitchEGL();
 };
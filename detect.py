@@ -44,6 +44,12 @@ def get_opts():
         EnumVariable("debug_symbols", "Add debugging symbols to release builds", "yes", ("yes", "no", "full")),
         BoolVariable("separate_debug_symbols", "Create a separate file containing debugging symbols", False),
         BoolVariable("touch", "Enable touch events", True),
+        BoolVariable("arena_allocator", "Serve heap allocations from an arena with merging free lists", False),
+        (
+            "heap_size_mb",
+            "Heap the game may use in MiB (0 = all available). Under hbloader, the heap it hands over is capped to this",
+            0,
+        ),
     ]
 
 
@@ -155,6 +161,17 @@ def configure(env):
     if env["touch"]:
         env.Append(CPPFLAGS=["-DTOUCH_ENABLED"])
 
+    env.Append(CPPFLAGS=["-DSWITCH_HEAP_SIZE_MB=" + str(int(env["heap_size_mb"]))])
+
+    if env["arena_allocator"]:
+        env.Append(CPPFLAGS=["-DSWITCH_ARENA_ALLOCATOR_ENABLED"])
+        env.Append(
+            LINKFLAGS=[
+                "-Wl,--wrap=malloc,--wrap=free,--wrap=calloc,--wrap=realloc,--wrap=malloc_usable_size",
+                "-Wl,--wrap=_free_r,--wrap=_realloc_r,--wrap=_malloc_usable_size_r",
+            ]
+        )
+
     # freetype depends on libpng and zlib, so bundling one of them while keeping others
     # as shared libraries leads to weird issues
     if env["builtin_freetype"] or env["builtin_libpng"] or env["builtin_zlib"]:
@@ -254,6 +271,16 @@ def configure(env):
         ]
     )
     env.Append(CPPFLAGS=["-DPTHREAD_NO_RENAME"])
+    # Sockets are initialized on first use, see network_switch.h.
+    env.Append(LINKFLAGS=["-Wl,--wrap=socket,--wrap=getaddrinfo,--wrap=gethostbyname"])
+    # Program building goes through the binary cache, see shader_cache_switch.h.
+    env.Append(
+        LINKFLAGS=[
+            "-Wl,--wrap=glShaderSource,--wrap=glAttachShader",
+            "-Wl,--wrap=glBindAttribLocation,--wrap=glTransformFeedbackVaryings,--wrap=glLinkProgram",
+            "-Wl,--wrap=glDeleteShader,--wrap=glDeleteProgram",
+        ]
+    )
     env.Append(LIBS=["EGL", "GLESv2", "glapi", "drm_nouveau", "nx"])
 
     # -lglad -lEGL -lglapi -ldrm_nouveau
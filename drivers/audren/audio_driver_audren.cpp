@@ -32,6 +32,8 @@
 
 #include "core/os/os.h"
 #include "core/project_settings.h"
+#include "logger_switch.h"
+#include "thread_switch.h"
 
 #include <errno.h>
 #include <malloc.h>
@@ -55,9 +57,9 @@ Error AudioDriverAudren::init_device() {
     samples_out.resize(buffer_size * channels);
 
     Result res = audrenInitialize(&arConfig);
-    printf("audrenInitialize: %x\n", res);
+    TRACE("audrenInitialize: %x", res);
     res = audrvCreate(&audren_driver, &arConfig, 2);
-    printf("audrenInitialize: %x\n", res);
+    TRACE("audrvCreate: %x", res);
 
     audren_buffer_size = (sizeof(int16_t) * buffer_size * channels);
     audren_pool_size = ((audren_buffer_size * 2) + 0xFFF) & ~0xFFF;
@@ -78,10 +80,10 @@ Error AudioDriverAudren::init_device() {
     audrvDeviceSinkAdd(&audren_driver, AUDREN_DEFAULT_DEVICE_NAME, 2, sink_channels);
 
     res = audrvUpdate(&audren_driver);
-    printf("audrvUpdate: %x\n", res);
+    TRACE("audrvUpdate: %x", res);
 
     res = audrenStartAudioRenderer();
-    printf("audrenStartAudioRenderer: %x\n", res);
+    TRACE("audrenStartAudioRenderer: %x", res);
 
     audrvVoiceInit(&audren_driver, 0, channels, PcmFormat_Int16, mix_rate);
     audrvVoiceSetDestinationMix(&audren_driver, 0, AUDREN_FINAL_MIX_ID);
@@ -100,6 +102,7 @@ Error AudioDriverAudren::init_device() {
 
 Error AudioDriverAudren::init() {
     active = false;
+    paused = false;
     thread_exited = false;
     exit_thread = false;
 
@@ -114,10 +117,17 @@ Error AudioDriverAudren::init() {
 void AudioDriverAudren::thread_func(void *p_udata) {
     AudioDriverAudren *ad = (AudioDriverAudren *)p_udata;
 
-    svcSetThreadPriority(CUR_THREAD_HANDLE, 0x2B);
+    ThreadSwitch::apply(ThreadSwitch::ROLE_AUDIO);
 
     while (!ad->exit_thread) {
         ad->lock();
+
+        if (ad->paused) {
+            ad->unlock();
+            OS::get_singleton()->delay_usec(10000);
+            continue;
+        }
+
         ad->start_counting_ticks();
 
         if (!ad->active) {
@@ -204,6 +214,16 @@ void AudioDriverAudren::unlock() {
     mutex.unlock();
 }
 
+void AudioDriverAudren::set_paused(bool p_paused) {
+    lock();
+    if (paused != p_paused) {
+        paused = p_paused;
+        audrvVoiceSetPaused(&audren_driver, 0, paused);
+        audrvUpdate(&audren_driver);
+    }
+    unlock();
+}
+
 void AudioDriverAudren::finish() {
     exit_thread = true;
     thread.wait_to_finish();
@@ -214,7 +234,9 @@ void AudioDriverAudren::finish() {
 
 AudioDriverAudren::AudioDriverAudren() :
         device_name("Default"),
-        new_device("Default") {
+        new_device("Default"),
+        active(false),
+        paused(false) {
 }
 
 AudioDriverAudren::~AudioDriverAudren() {
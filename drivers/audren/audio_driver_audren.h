@@ -64,6 +64,7 @@ class AudioDriverAudren : public AudioDriver {
     int channels;
 
     bool active;
+    bool paused;
     bool thread_exited;
     mutable bool exit_thread;
 
@@ -83,6 +84,9 @@ public:
     virtual void unlock();
     virtual void finish();
 
+    // Stops feeding the renderer while the application is out of focus.
+    void set_paused(bool p_paused);
+
     AudioDriverAudren();
     ~AudioDriverAudren();
 };
@@ -34,15 +34,19 @@
 
 #include "export.h"
 
+#include "core/io/compression.h"
 #include "core/io/packet_peer_udp.h"
 #include "core/os/file_access.h"
 #include "editor/editor_export.h"
 #include "editor/editor_node.h"
+#include "main/splash.gen.h"
 #include "platform/switch/logo.gen.h"
 #include "scene/resources/texture.h"
 
 #define TEMPLATE_RELEASE "switch_release.nro"
 #define TEMPLATE_APPLET_SPLASH "switch_applet_splash.rgba.gz"
+// Optional, decodes faster than the gzip one on device.
+#define TEMPLATE_APPLET_SPLASH_ZSTD "switch_applet_splash.rgba.zst"
 
 class ExportPluginSwitch : public EditorExportPlugin {
 public:
@@ -131,6 +135,10 @@ class EditorExportPlatformSwitch : public EditorExportPlatform {
 
 public:
 	virtual void get_preset_features(const Ref<EditorExportPreset> &p_preset, List<String> *r_features) {
+		if (p_preset->get("texture_format/astc")) {
+			r_features->push_back("astc");
+		}
+
 		String driver = ProjectSettings::get_singleton()->get("rendering/quality/driver/driver_name");
 		if (driver == "GLES2") {
 			r_features->push_back("etc");
@@ -149,6 +157,8 @@ public:
 	virtual void get_export_options(List<ExportOption> *r_options) {
 		String title = ProjectSettings::get_singleton()->get("application/config/name");
 		r_options->push_back(ExportOption(PropertyInfo(Variant::BOOL, "binary_format/embed_pck"), false));
+		r_options->push_back(ExportOption(PropertyInfo(Variant::BOOL, "binary_format/launch_splash"), true));
+		r_options->push_back(ExportOption(PropertyInfo(Variant::BOOL, "texture_format/astc"), false));
 
 		r_options->push_back(ExportOption(PropertyInfo(Variant::STRING, "application/custom_editor_id"), ""));
 		r_options->push_back(ExportOption(PropertyInfo(Variant::STRING, "application/title", PROPERTY_HINT_PLACEHOLDER_TEXT, title), title));
@@ -382,6 +392,13 @@ public:
 				err = save_pack(p_preset, romfs_dir.plus_file("game.pck"));
 				if (err == OK) {
 					String applet_splash = find_export_template(TEMPLATE_APPLET_SPLASH);
+					String applet_splash_zstd = find_export_template(TEMPLATE_APPLET_SPLASH_ZSTD);
+					if (applet_splash_zstd != String() && FileAccess::exists(applet_splash_zstd)) {
+						da->copy(applet_splash_zstd, romfs_dir.plus_file("applet_splash.rgba.zst"));
+					}
+					if (p_preset->get("binary_format/launch_splash")) {
+						save_launch_splash(romfs_dir.plus_file("boot_splash.rgba.zst"));
+					}
 					if (FileAccess::exists(applet_splash)) {
 						da->copy(applet_splash, romfs_dir.plus_file("applet_splash.rgba.gz"));
 
@@ -426,6 +443,59 @@ public:
 		return err;
 	}
 
+	// Renders the project's boot splash to the raw 1280x720 RGBA the template
+	// shows from romfs while the engine boots.
+	Error save_launch_splash(const String &p_path) {
+		if (!(bool)GLOBAL_GET("application/boot_splash/show_image")) {
+			return OK;
+		}
+
+		Ref<Image> splash;
+		String splash_path = GLOBAL_GET("application/boot_splash/image");
+		if (splash_path != String()) {
+			splash.instance();
+			if (splash->load(splash_path) != OK) {
+				splash.unref();
+			}
+		}
+		if (splash.is_null()) {
+			splash = Ref<Image>(memnew(Image(boot_splash_png)));
+		}
+		splash->convert(Image::FORMAT_RGBA8);
+
+		const int width = 1280;
+		const int height = 720;
+		Size2 size = splash->get_size();
+		if ((bool)GLOBAL_GET("application/boot_splash/fullsize") || size.width > width || size.height > height) {
+			float scale = MIN(width / size.width, height / size.height);
+			size = (size * scale).floor();
+			splash->resize(size.width, size.height);
+		}
+
+		Ref<Image> screen;
+		screen.instance();
+		screen->create(width, height, false, Image::FORMAT_RGBA8);
+		Color bg_color = GLOBAL_GET("application/boot_splash/bg_color");
+		bg_color.a = 1.0;
+		screen->fill(bg_color);
+		Point2 pos = ((Size2(width, height) - size) / 2).floor();
+		screen->blend_rect(splash, Rect2(Point2(), size), pos);
+
+		PoolVector<uint8_t> data = screen->get_data();
+		PoolVector<uint8_t>::Read r = data.read();
+		Vector<uint8_t> compressed;
+		compressed.resize(Compression::get_max_compressed_buffer_size(data.size(), Compression::MODE_ZSTD));
+		int compressed_size = Compression::compress(compressed.ptrw(), r.ptr(), data.size(), Compression::MODE_ZSTD);
+		ERR_FAIL_COND_V(compressed_size < 0, ERR_CANT_CREATE);
+
+		FileAccess *f = FileAccess::open(p_path, FileAccess::WRITE);
+		ERR_FAIL_COND_V(!f, ERR_CANT_CREATE);
+		f->store_buffer(compressed.ptr(), compressed_size);
+		f->close();
+		memdelete(f);
+		return OK;
+	}
+
 	void copy_chunked(FileAccess *src, FileAccess *dst, size_t len, size_t chunk_size = 0x100000) {
 		uint8_t *buffer = (uint8_t *)malloc(chunk_size);
 		while (len > chunk_size) {
@@ -0,0 +1,413 @@
+/**************************************************************************/
+/*  file_access_switch.cpp                                                */
+/**************************************************************************/
+/*                         This file is part of:                          */
+/*                             GODOT ENGINE                               */
+/*                        https://godotengine.org                         */
+/**************************************************************************/
+/* Copyright (c) 2014-present Godot Engine contributors (see AUTHORS.md). */
+/* Copyright (c) 2007-2014 Juan Linietsky, Ariel Manzur.                  */
+/*                                                                        */
+/* Permission is hereby granted, free of charge, to any person obtaining  */
+/* a copy of this software and associated documentation files (the        */
+/* "Software"), to deal in the Software without restriction, including    */
+/* without limitation the rights to use, copy, modify, merge, publish,    */
+/* distribute, sublicense, and/or sell copies of the Software, and to     */
+/* permit persons to whom the Software is furnished to do so, subject to  */
+/* the following conditions:                                              */
+/*                                                                        */
+/* The above copyright notice and this permission notice shall be         */
+/* included in all copies or substantial portions of the Software.        */
+/*                                                                        */
+/* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,        */
+/* EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF     */
+/* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. */
+/* IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY   */
+/* CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,   */
+/* TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE      */
+/* SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.                 */
+/**************************************************************************/
+
+#include "file_access_switch.h"
+
+#include <malloc.h>
+#include <string.h>
+
+// Returns the SD card filesystem and the path on it, or null for other devices.
+FsFileSystem *FileAccessSwitch::_get_fs_path(const String &p_path, char *r_fs_path) {
+	String fs_path;
+	if (p_path.begins_with("sdmc:/")) {
+		fs_path = p_path.substr(5, p_path.length() - 5);
+	} else if (p_path.begins_with("/")) {
+		// The SD card is the default device
+		fs_path = p_path;
+	} else {
+		return nullptr;
+	}
+
+	CharString utf8 = fs_path.utf8();
+	if (utf8.length() >= FS_MAX_PATH) {
+		return nullptr;
+	}
+
+	// The fs service always reads FS_MAX_PATH bytes.
+	memset(r_fs_path, 0, FS_MAX_PATH);
+	memcpy(r_fs_path, utf8.get_data(), utf8.length());
+	return fsdevGetDeviceFileSystem("sdmc");
+}
+
+void FileAccessSwitch::_flush_buffer() const {
+	if (!buffer_dirty) {
+		return;
+	}
+	buffer_dirty = false;
+
+	if (buffer_size && R_FAILED(fsFileWrite(&file, buffer_offset, buffer, buffer_size, FsWriteOption_None))) {
+		last_error = ERR_FILE_CANT_WRITE;
+		buffer_size = 0;
+	}
+}
+
+void FileAccessSwitch::_fill_buffer(uint64_t p_offset) const {
+	_flush_buffer();
+
+	// Aligned reads are cheaper for the fs service.
+	buffer_offset = p_offset - (p_offset % BUFFER_ALIGN);
+	buffer_size = 0;
+
+	u64 read = 0;
+	if (R_FAILED(fsFileRead(&file, buffer_offset, buffer, BUFFER_SIZE, FsReadOption_None, &read))) {
+		last_error = ERR_FILE_CANT_READ;
+		return;
+	}
+	buffer_size = read;
+}
+
+bool FileAccessSwitch::_get_file_entry(FsFileSystem *p_fs, const String &p_path, const char *p_fs_path, bool p_restore) {
+	FsDirEntryType type;
+	if (R_SUCCEEDED(fsFsGetEntryType(p_fs, p_fs_path, &type))) {
+		return type == FsDirEntryType_File;
+	}
+
+	// A save interrupted between moving the previous file aside and putting
+	// the new one in place leaves only the backup.
+	char backup_fs_path[FS_MAX_PATH];
+	if (!_get_fs_path(p_path + ".bak", backup_fs_path)) {
+		return false;
+	}
+	if (p_restore) {
+		return R_SUCCEEDED(fsFsRenameFile(p_fs, backup_fs_path, p_fs_path));
+	}
+	return R_SUCCEEDED(fsFsGetEntryType(p_fs, backup_fs_path, &type)) && type == FsDirEntryType_File;
+}
+
+Error FileAccessSwitch::_open(const String &p_path, int p_mode_flags) {
+	if (native) {
+		_close_native();
+	}
+
+	String fixed_path = fix_path(p_path);
+	char fs_path[FS_MAX_PATH];
+	FsFileSystem *fs = _get_fs_path(fixed_path, fs_path);
+	if (!fs) {
+		return FileAccessUnix::_open(p_path, p_mode_flags);
+	}
+	FileAccessUnix::close();
+
+	path_src = p_path;
+	path = fixed_path;
+	flags = p_mode_flags;
+	save_path = "";
+	pos = 0;
+	eof = false;
+	last_error = OK;
+
+	if (p_mode_flags == READ || p_mode_flags == READ_WRITE) {
+		if (!_get_file_entry(fs, fixed_path, fs_path, true)) {
+			last_error = ERR_FILE_NOT_FOUND;
+			return last_error;
+		}
+	} else {
+		if (p_mode_flags == WRITE) {
+			// Like FileAccessUnix: write aside so a crash never leaves a truncated file.
+			save_path = fixed_path;
+			strncat(fs_path, ".tmp", FS_MAX_PATH - strlen(fs_path) - 1);
+		}
+		// Fails harmlessly if the file is already there.
+		fsFsCreateFile(fs, fs_path, 0, 0);
+	}
+
+	u32 mode = FsOpenMode_Read;
+	if (p_mode_flags != READ) {
+		mode |= FsOpenMode_Write | FsOpenMode_Append;
+	}
+	if (R_FAILED(fsFsOpenFile(fs, fs_path, mode, &file))) {
+		last_error = ERR_FILE_CANT_OPEN;
+		return last_error;
+	}
+
+	s64 size = 0;
+	if (p_mode_flags == WRITE || p_mode_flags == WRITE_READ) {
+		fsFileSetSize(&file, 0);
+	} else {
+		fsFileGetSize(&file, &size);
+	}
+	length = size;
+
+	if (!buffer) {
+		buffer = (uint8_t *)memalign(BUFFER_ALIGN, BUFFER_SIZE);
+		if (!buffer) {
+			fsFileClose(&file);
+			last_error = ERR_OUT_OF_MEMORY;
+			return last_error;
+		}
+	}
+	buffer_size = 0;
+	buffer_dirty = false;
+
+	native = true;
+	return OK;
+}
+
+void FileAccessSwitch::_close_native() {
+	_flush_buffer();
+	fsFileFlush(&file);
+	fsFileClose(&file);
+	native = false;
+
+	if (save_path != "") {
+		char fs_path[FS_MAX_PATH];
+		char tmp_fs_path[FS_MAX_PATH];
+		FsFileSystem *fs = _get_fs_path(save_path, fs_path);
+		_get_fs_path(save_path + ".tmp", tmp_fs_path);
+
+		char backup_fs_path[FS_MAX_PATH];
+		_get_fs_path(save_path + ".bak", backup_fs_path);
+
+		// fsFsRenameFile doesn't replace an existing file, so the previous one is
+		// moved aside and only deleted once the new one is in place.
+		FsDirEntryType type;
+		bool had_previous = R_SUCCEEDED(fsFsGetEntryType(fs, fs_path, &type));
+		if (had_previous) {
+			// A backup left next to an existing file is stale.
+			fsFsDeleteFile(fs, backup_fs_path);
+		}
+		if (had_previous && R_FAILED(fsFsRenameFile(fs, fs_path, backup_fs_path))) {
+			fsFsDeleteFile(fs, tmp_fs_path);
+			last_error = ERR_FILE_CANT_WRITE;
+		} else if (R_SUCCEEDED(fsFsRenameFile(fs, tmp_fs_path, fs_path))) {
+			fsFsDeleteFile(fs, backup_fs_path);
+		} else {
+			if (had_previous) {
+				fsFsRenameFile(fs, backup_fs_path, fs_path);
+			}
+			fsFsDeleteFile(fs, tmp_fs_path);
+			last_error = ERR_FILE_CANT_WRITE;
+		}
+		if (close_notification_func) {
+			close_notification_func(path, flags);
+		}
+		save_path = "";
+	}
+}
+
+void FileAccessSwitch::close() {
+	if (native) {
+		_close_native();
+	} else {
+		FileAccessUnix::close();
+	}
+}
+
+bool FileAccessSwitch::is_open() const {
+	return native || FileAccessUnix::is_open();
+}
+
+String FileAccessSwitch::get_path() const {
+	return native ? path_src : FileAccessUnix::get_path();
+}
+
+String FileAccessSwitch::get_path_absolute() const {
+	return native ? path : FileAccessUnix::get_path_absolute();
+}
+
+void FileAccessSwitch::seek(uint64_t p_position) {
+	if (!native) {
+		FileAccessUnix::seek(p_position);
+		return;
+	}
+	pos = p_position;
+	eof = false;
+}
+
+void FileAccessSwitch::seek_end(int64_t p_position) {
+	if (!native) {
+		FileAccessUnix::seek_end(p_position);
+		return;
+	}
+	pos = length + p_position;
+	eof = false;
+}
+
+uint64_t FileAccessSwitch::get_position() const {
+	return native ? pos : FileAccessUnix::get_position();
+}
+
+uint64_t FileAccessSwitch::get_len() const {
+	return native ? length : FileAccessUnix::get_len();
+}
+
+bool FileAccessSwitch::eof_reached() const {
+	return native ? eof : FileAccessUnix::eof_reached();
+}
+
+uint8_t FileAccessSwitch::get_8() const {
+	if (!native) {
+		return FileAccessUnix::get_8();
+	}
+
+	if (pos >= buffer_offset && pos < buffer_offset + buffer_size) {
+		return buffer[pos++ - buffer_offset];
+	}
+
+	uint8_t b = 0;
+	get_buffer(&b, 1);
+	return b;
+}
+
+uint64_t FileAccessSwitch::get_buffer(uint8_t *p_dst, uint64_t p_length) const {
+	if (!native) {
+		return FileAccessUnix::get_buffer(p_dst, p_length);
+	}
+	ERR_FAIL_COND_V(!p_dst && p_length > 0, -1);
+
+	uint64_t done = 0;
+	while (done < p_length) {
+		if (pos >= buffer_offset && pos < buffer_offset + buffer_size) {
+			uint64_t count = MIN(p_length - done, buffer_offset + buffer_size - pos);
+			memcpy(p_dst + done, buffer + (pos - buffer_offset), count);
+			done += count;
+			pos += count;
+			continue;
+		}
+		if (pos >= length) {
+			break;
+		}
+
+		uint64_t remaining = p_length - done;
+		if (remaining >= BUFFER_SIZE) {
+			// Large reads go straight into the caller's memory
+			_flush_buffer();
+			u64 read = 0;
+			if (R_FAILED(fsFileRead(&file, pos, p_dst + done, remaining, FsReadOption_None, &read))) {
+				last_error = ERR_FILE_CANT_READ;
+				break;
+			}
+			done += read;
+			pos += read;
+			if (read < remaining) {
+				break;
+			}
+			continue;
+		}
+
+		_fill_buffer(pos);
+		if (pos >= buffer_offset + buffer_size) {
+			break;
+		}
+	}
+
+	if (done < p_length) {
+		eof = true;
+	}
+	return done;
+}
+
+Error FileAccessSwitch::get_error() const {
+	if (!native) {
+		return FileAccessUnix::get_error();
+	}
+	return eof ? ERR_FILE_EOF : last_error;
+}
+
+void FileAccessSwitch::flush() {
+	if (!native) {
+		FileAccessUnix::flush();
+		return;
+	}
+	_flush_buffer();
+	fsFileFlush(&file);
+}
+
+void FileAccessSwitch::store_8(uint8_t p_dest) {
+	if (!native) {
+		FileAccessUnix::store_8(p_dest);
+		return;
+	}
+	store_buffer(&p_dest, 1);
+}
+
+void FileAccessSwitch::store_buffer(const uint8_t *p_src, uint64_t p_length) {
+	if (!native) {
+		FileAccessUnix::store_buffer(p_src, p_length);
+		return;
+	}
+	ERR_FAIL_COND(!p_src && p_length > 0);
+	ERR_FAIL_COND_MSG(flags == READ, "File was opened read-only.");
+
+	if (p_length >= BUFFER_SIZE) {
+		_flush_buffer();
+		buffer_size = 0;
+		if (R_FAILED(fsFileWrite(&file, pos, p_src, p_length, FsWriteOption_None))) {
+			last_error = ERR_FILE_CANT_WRITE;
+			return;
+		}
+	} else {
+		// Keep appending to the pending write while it stays contiguous.
+		if (!buffer_dirty || pos != buffer_offset + buffer_size || buffer_size + p_length > BUFFER_SIZE) {
+			_flush_buffer();
+			buffer_offset = pos;
+			buffer_size = 0;
+			buffer_dirty = true;
+		}
+		memcpy(buffer + buffer_size, p_src, p_length);
+		buffer_size += p_length;
+	}
+
+	pos += p_length;
+	length = MAX(length, pos);
+}
+
+bool FileAccessSwitch::file_exists(const String &p_path) {
+	char fs_path[FS_MAX_PATH];
+	FsFileSystem *fs = _get_fs_path(fix_path(p_path), fs_path);
+	if (!fs) {
+		return FileAccessUnix::file_exists(p_path);
+	}
+
+	// Checking doesn't write, the backup is restored when the file is opened.
+	return _get_file_entry(fs, fix_path(p_path), fs_path, false);
+}
+
+uint64_t FileAccessSwitch::_get_modified_time(const String &p_file) {
+	char fs_path[FS_MAX_PATH];
+	FsFileSystem *fs = _get_fs_path(fix_path(p_file), fs_path);
+	if (!fs) {
+		return FileAccessUnix::_get_modified_time(p_file);
+	}
+
+	FsTimeStampRaw timestamp;
+	if (R_FAILED(fsFsGetFileTimeStampRaw(fs, fs_path, &timestamp)) || !timestamp.is_valid) {
+		return 0;
+	}
+	return timestamp.modified;
+}
+
+FileAccessSwitch::~FileAccessSwitch() {
+	if (native) {
+		_close_native();
+	}
+	if (buffer) {
+		free(buffer);
+	}
+}
@@ -0,0 +1,105 @@
+/**************************************************************************/
+/*  file_access_switch.h                                                  */
+/**************************************************************************/
+/*                         This file is part of:                          */
+/*                             GODOT ENGINE                               */
+/*                        https://godotengine.org                         */
+/**************************************************************************/
+/* Copyright (c) 2014-present Godot Engine contributors (see AUTHORS.md). */
+/* Copyright (c) 2007-2014 Juan Linietsky, Ariel Manzur.                  */
+/*                                                                        */
+/* Permission is hereby granted, free of charge, to any person obtaining  */
+/* a copy of this software and associated documentation files (the        */
+/* "Software"), to deal in the Software without restriction, including    */
+/* without limitation the rights to use, copy, modify, merge, publish,    */
+/* distribute, sublicense, and/or sell copies of the Software, and to     */
+/* permit persons to whom the Software is furnished to do so, subject to  */
+/* the following conditions:                                              */
+/*                                                                        */
+/* The above copyright notice and this permission notice shall be         */
+/* included in all copies or substantial portions of the Software.        */
+/*                                                                        */
+/* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,        */
+/* EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF     */
+/* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. */
+/* IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY   */
+/* CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,   */
+/* TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE      */
+/* SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.                 */
+/**************************************************************************/
+
+#ifndef FILE_ACCESS_SWITCH_H
+#define FILE_ACCESS_SWITCH_H
+
+#include "drivers/unix/file_access_unix.h"
+#include "switch_wrapper.h"
+
+// Files on the SD card are read and written through the fs service directly,
+// skipping newlib's FILE buffering and the devoptab layer: one aligned buffer
+// serves as read-ahead or write-behind, and large transfers bypass it entirely.
+// Everything else (romfs:/, ...) goes through FileAccessUnix.
+class FileAccessSwitch : public FileAccessUnix {
+	enum {
+		BUFFER_SIZE = 64 * 1024,
+		BUFFER_ALIGN = 4096,
+	};
+
+	bool native = false;
+	mutable FsFile file;
+	int flags = 0;
+	String path;
+	String path_src;
+	String save_path; // WRITE mode goes to a temporary file, swapped in for this on close
+
+	mutable uint64_t pos = 0;
+	uint64_t length = 0;
+	mutable bool eof = false;
+	mutable Error last_error = OK;
+
+	mutable uint8_t *buffer = nullptr;
+	mutable uint64_t buffer_offset = 0; // file offset of buffer[0]
+	mutable uint64_t buffer_size = 0; // valid bytes in the buffer
+	mutable bool buffer_dirty = false; // the buffer holds writes not sent yet
+
+	void _flush_buffer() const;
+	void _fill_buffer(uint64_t p_offset) const;
+	void _close_native();
+
+	static FsFileSystem *_get_fs_path(const String &p_path, char *r_fs_path);
+	// Counts a save backup left without its file, and restores the file from it
+	// with p_restore.
+	static bool _get_file_entry(FsFileSystem *p_fs, const String &p_path, const char *p_fs_path, bool p_restore);
+
+public:
+	virtual Error _open(const String &p_path, int p_mode_flags);
+	virtual void close();
+	virtual bool is_open() const;
+
+	virtual String get_path() const;
+	virtual String get_path_absolute() const;
+
+	virtual void seek(uint64_t p_position);
+	virtual void seek_end(int64_t p_position = 0);
+	virtual uint64_t get_position() const;
+	virtual uint64_t get_len() const;
+
+	virtual bool eof_reached() const;
+
+	virtual uint8_t get_8() const;
+	virtual uint64_t get_buffer(uint8_t *p_dst, uint64_t p_length) const;
+
+	virtual Error get_error() const;
+
+	virtual void flush();
+	virtual void store_8(uint8_t p_dest);
+	virtual void store_buffer(const uint8_t *p_src, uint64_t p_length);
+
+	virtual bool file_exists(const String &p_path);
+
+	virtual uint64_t _get_modified_time(const String &p_file);
+
+	FileAccessSwitch() {}
+	virtual ~FileAccessSwitch();
+};
+
+#endif // FILE_ACCESS_SWITCH_H
@@ -31,70 +31,71 @@
 #include "switch_wrapper.h"
 #include <limits.h>
 #include <locale.h>
+#include <netinet/in.h>
 #include <stdlib.h>
 #include <unistd.h>
-#include <zlib.h>
 
+#include "core/project_settings.h"
 #include "main/main.h"
+#include "network_switch.h"
 #include "os_switch.h"
+#include "splash_switch.h"
+#include "startup_timeline_switch.h"
 
 #define FB_WIDTH 1280
 #define FB_HEIGHT 720
 
+#ifndef SWITCH_HEAP_SIZE_MB
+#define SWITCH_HEAP_SIZE_MB 0
+#endif
+
+#if SWITCH_HEAP_SIZE_MB > 0
+// Rounded up to the 2 MiB heap granularity.
+#define SWITCH_HEAP_SIZE ((((u64)SWITCH_HEAP_SIZE_MB << 20) + 0x1FFFFF) & ~(u64)0x1FFFFF)
+
+extern "C" {
+extern char *fake_heap_start;
+extern char *fake_heap_end;
+
+// Replaces libnx's weak default, which ignores __nx_heap_size when a homebrew
+// loader hands us its own heap, as it does for every NRO launch. That heap is
+// capped instead: newlib never grows past the limit, the rest stays unused.
+void __libnx_initheap(void) {
+	void *addr;
+	u64 size = SWITCH_HEAP_SIZE;
+	if (envHasHeapOverride()) {
+		addr = envGetHeapOverrideAddr();
+		size = MIN(size, envGetHeapOverrideSize());
+	} else if (R_FAILED(svcSetHeapSize(&addr, size))) {
+		diagAbortWithResult(MAKERESULT(Module_Libnx, LibnxError_HeapAllocFailed));
+	}
+	fake_heap_start = (char *)addr;
+	fake_heap_end = (char *)addr + size;
+}
+}
+#endif
+
 int main(int argc, char *argv[]) {
-	socketInitializeDefault();
-	nxlinkStdio();
+	// Only redirect stdio when we were actually launched through nxlink,
+	// which is also the only case that needs sockets this early.
+	if (__nxlink_host.s_addr != 0) {
+		StartupTimelineSwitch::begin("nxlinkStdio");
+		network_switch_ensure_initialized();
+		nxlinkStdio();
+		StartupTimelineSwitch::end();
+	}
 
+	StartupTimelineSwitch::begin("romfsInit");
 	romfsInit();
+	StartupTimelineSwitch::end();
 
 	int apptype = appletGetAppletType();
 	if (apptype != AppletType_Application && apptype != AppletType_SystemApplication) {
-		NWindow *win = nwindowGetDefault();
-		Framebuffer fb;
-		framebufferCreate(&fb, win, FB_WIDTH, FB_HEIGHT, PIXEL_FORMAT_RGBA_8888, 1);
-		framebufferMakeLinear(&fb);
-
-		u32 stride;
-		u32 *framebuf = (u32 *)framebufferBegin(&fb, &stride);
-
-		FILE *splash = fopen("romfs:/applet_splash.rgba.gz", "rb");
-		if (splash) {
-			fseek(splash, 0, SEEK_END);
-			size_t splash_size = ftell(splash);
-
-			u8 *compressed_splash = (u8 *)malloc(splash_size);
-			memset(compressed_splash, 0, splash_size);
-			fseek(splash, 0, SEEK_SET);
-
-			fread(compressed_splash, 1, splash_size, splash);
-			fclose(splash);
-
-			memset(framebuf, 0, stride * FB_HEIGHT);
-
-			struct z_stream_s stream;
-			memset(&stream, 0, sizeof(stream));
-			stream.zalloc = NULL;
-
-			stream.zfree = NULL;
-			stream.next_in = compressed_splash;
-			stream.avail_in = splash_size;
-			stream.next_out = (u8 *)framebuf;
-			stream.avail_out = stride * FB_HEIGHT;
-
-			if (inflateInit2(&stream, 16 + MAX_WBITS) == Z_OK) {
-				int err = 0;
-				if ((err = inflate(&stream, 0)) != Z_STREAM_END) {
-					// idk
-				}
-
-				inflateEnd(&stream);
-			}
-		} else {
+		if (!splash_switch_show("romfs:/applet_splash", FB_WIDTH, FB_HEIGHT)) {
 			// this REALLY shouldn't fail. Hm.
+			printf("Unable to show the applet splash.\n");
 		}
 
-		framebufferEnd(&fb);
-
 		// set up input
 		PadState pad;
 		padConfigureInput(1, HidNpadStyleSet_NpadStandard);
@@ -106,29 +107,47 @@ int main(int argc, char *argv[]) {
 			}
 		}
 
-		framebufferClose(&fb);
+		splash_switch_close();
 
 		romfsExit();
-		socketExit();
+		network_switch_finalize();
 
 		return 0;
 	}
 
+	// Keep something on screen while Main::setup loads, until the GL context
+	// takes the window over.
+	StartupTimelineSwitch::begin("boot splash");
+	splash_switch_show("romfs:/boot_splash", FB_WIDTH, FB_HEIGHT);
+	StartupTimelineSwitch::end();
+
 	OS_Switch os;
 	os.set_executable_path(argv[0]);
 
 	char *cwd = (char *)malloc(PATH_MAX);
 	getcwd(cwd, PATH_MAX);
 
+	StartupTimelineSwitch::begin("Main::setup");
 	Error err = Main::setup(argv[0], argc - 1, &argv[1]);
+	StartupTimelineSwitch::end();
 	if (err != OK) {
+		splash_switch_close();
 		free(cwd);
 
-		socketExit();
+		network_switch_finalize();
 		return 255;
 	}
 
-	if (Main::start()) {
+	StartupTimelineSwitch::begin("Main::start");
+	bool started = Main::start();
+	StartupTimelineSwitch::end();
+
+	if (started) {
+		StartupTimelineSwitch::print_summary();
+		if (GLOBAL_DEF("debug/settings/switch/save_startup_trace", false)) {
+			StartupTimelineSwitch::save_chrome_trace(os.get_user_data_dir().plus_file("startup_trace.json"));
+		}
+
 		os.run(); // it is actually the OS that decides how to run
 	}
 	Main::cleanup();
@@ -137,6 +156,6 @@ int main(int argc, char *argv[]) {
 	free(cwd);
 
 	romfsExit();
-	socketExit();
+	network_switch_finalize();
 	return os.get_exit_code();
 }
@@ -0,0 +1,130 @@
+/**************************************************************************/
+/*  gpu_timer_switch.cpp                                                  */
+/**************************************************************************/
+/*                         This file is part of:                          */
+/*                             GODOT ENGINE                               */
+/*                        https://godotengine.org                         */
+/**************************************************************************/
+/* Copyright (c) 2014-present Godot Engine contributors (see AUTHORS.md). */
+/* Copyright (c) 2007-2014 Juan Linietsky, Ariel Manzur.                  */
+/*                                                                        */
+/* Permission is hereby granted, free of charge, to any person obtaining  */
+/* a copy of this software and associated documentation files (the        */
+/* "Software"), to deal in the Software without restriction, including    */
+/* without limitation the rights to use, copy, modify, merge, publish,    */
+/* distribute, sublicense, and/or sell copies of the Software, and to     */
+/* permit persons to whom the Software is furnished to do so, subject to  */
+/* the following conditions:                                              */
+/*                                                                        */
+/* The above copyright notice and this permission notice shall be         */
+/* included in all copies or substantial portions of the Software.        */
+/*                                                                        */
+/* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,        */
+/* EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF     */
+/* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. */
+/* IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY   */
+/* CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,   */
+/* TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE      */
+/* SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.                 */
+/**************************************************************************/
+
+#include "gpu_timer_switch.h"
+
+#include <EGL/egl.h>
+#include <string.h>
+
+void GPUTimerSwitch::_read_back(int p_index) {
+	GLint available = 0;
+	get_query_objectiv(queries[p_index], GL_QUERY_RESULT_AVAILABLE_EXT, &available);
+	if (!available) {
+		// Still running after QUERY_COUNT - 1 frames, drop it rather than wait.
+		query_pending[p_index] = false;
+		return;
+	}
+
+	GLuint64 elapsed_ns = 0;
+	get_query_objectui64v(queries[p_index], GL_QUERY_RESULT_EXT, &elapsed_ns);
+	query_pending[p_index] = false;
+
+	uint32_t usec = elapsed_ns / 1000;
+	last_usec.store(usec, std::memory_order_relaxed);
+	uint32_t average = average_usec.load(std::memory_order_relaxed);
+	average_usec.store(average ? average + ((int32_t)usec - (int32_t)average) / 16 : usec, std::memory_order_relaxed);
+}
+
+void GPUTimerSwitch::initialize() {
+	reset();
+
+	const char *extensions = (const char *)glGetString(GL_EXTENSIONS);
+	if (!extensions || !strstr(extensions, "GL_EXT_disjoint_timer_query")) {
+		return;
+	}
+
+	gen_queries = (PFNGLGENQUERIESEXTPROC)eglGetProcAddress("glGenQueriesEXT");
+	begin_query = (PFNGLBEGINQUERYEXTPROC)eglGetProcAddress("glBeginQueryEXT");
+	end_query = (PFNGLENDQUERYEXTPROC)eglGetProcAddress("glEndQueryEXT");
+	get_query_objectiv = (PFNGLGETQUERYOBJECTIVEXTPROC)eglGetProcAddress("glGetQueryObjectivEXT");
+	get_query_objectui64v = (PFNGLGETQUERYOBJECTUI64VEXTPROC)eglGetProcAddress("glGetQueryObjectui64vEXT");
+	if (!gen_queries || !begin_query || !end_query || !get_query_objectiv || !get_query_objectui64v) {
+		return;
+	}
+
+	gen_queries(QUERY_COUNT, queries);
+	supported = true;
+	begin_frame();
+}
+
+void GPUTimerSwitch::begin_frame() {
+	if (!supported || query_open) {
+		return;
+	}
+
+	// A disjoint operation (clock change, power state, ...) invalidates whatever is in flight.
+	GLint disjoint = 0;
+	glGetIntegerv(GL_GPU_DISJOINT_EXT, &disjoint);
+	if (disjoint) {
+		for (int i = 0; i < QUERY_COUNT; i++) {
+			query_pending[i] = false;
+		}
+	}
+
+	// The slot about to be reused holds the oldest frame.
+	if (query_pending[current]) {
+		_read_back(current);
+	}
+
+	begin_query(GL_TIME_ELAPSED_EXT, queries[current]);
+	query_open = true;
+}
+
+void GPUTimerSwitch::end_frame() {
+	if (!query_open) {
+		return;
+	}
+
+	end_query(GL_TIME_ELAPSED_EXT);
+	query_pending[current] = true;
+	current = (current + 1) % QUERY_COUNT;
+	query_open = false;
+}
+
+void GPUTimerSwitch::reset() {
+	supported = false;
+	current = 0;
+	query_open = false;
+	for (int i = 0; i < QUERY_COUNT; i++) {
+		queries[i] = 0;
+		query_pending[i] = false;
+	}
+}
+
+GPUTimerSwitch::GPUTimerSwitch() {
+	gen_queries = nullptr;
+	begin_query = nullptr;
+	end_query = nullptr;
+	get_query_objectiv = nullptr;
+	get_query_objectui64v = nullptr;
+	last_usec.store(0);
+	average_usec.store(0);
+	reset();
+}
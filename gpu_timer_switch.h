@@ -0,0 +1,80 @@
+/**************************************************************************/
+/*  gpu_timer_switch.h                                                    */
+/**************************************************************************/
+/*                         This file is part of:                          */
+/*                             GODOT ENGINE                               */
+/*                        https://godotengine.org                         */
+/**************************************************************************/
+/* Copyright (c) 2014-present Godot Engine contributors (see AUTHORS.md). */
+/* Copyright (c) 2007-2014 Juan Linietsky, Ariel Manzur.                  */
+/*                                                                        */
+/* Permission is hereby granted, free of charge, to any person obtaining  */
+/* a copy of this software and associated documentation files (the        */
+/* "Software"), to deal in the Software without restriction, including    */
+/* without limitation the rights to use, copy, modify, merge, publish,    */
+/* distribute, sublicense, and/or sell copies of the Software, and to     */
+/* permit persons to whom the Software is furnished to do so, subject to  */
+/* the following conditions:                                              */
+/*                                                                        */
+/* The above copyright notice and this permission notice shall be         */
+/* included in all copies or substantial portions of the Software.        */
+/*                                                                        */
+/* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,        */
+/* EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF     */
+/* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. */
+/* IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY   */
+/* CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,   */
+/* TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE      */
+/* SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.                 */
+/**************************************************************************/
+
+#ifndef GPU_TIMER_SWITCH_H
+#define GPU_TIMER_SWITCH_H
+
+#include <GLES2/gl2ext.h>
+#include <GLES3/gl3.h>
+#include <stdint.h>
+#include <atomic>
+
+// GPU time spent on each frame, measured with EXT_disjoint_timer_query between
+// two swaps. Results are read back QUERY_COUNT - 1 frames later so the render
+// thread never waits on them.
+class GPUTimerSwitch {
+	enum {
+		QUERY_COUNT = 4,
+	};
+
+	bool supported;
+	GLuint queries[QUERY_COUNT];
+	bool query_pending[QUERY_COUNT];
+	int current;
+	bool query_open;
+
+	std::atomic<uint32_t> last_usec;
+	std::atomic<uint32_t> average_usec;
+
+	PFNGLGENQUERIESEXTPROC gen_queries;
+	PFNGLBEGINQUERYEXTPROC begin_query;
+	PFNGLENDQUERYEXTPROC end_query;
+	PFNGLGETQUERYOBJECTIVEXTPROC get_query_objectiv;
+	PFNGLGETQUERYOBJECTUI64VEXTPROC get_query_objectui64v;
+
+	void _read_back(int p_index);
+
+public:
+	// Both need the context to be current.
+	void initialize();
+	void begin_frame();
+	void end_frame();
+
+	// Forgets the queries, they go away with the context.
+	void reset();
+
+	bool is_supported() const { return supported; }
+	uint32_t get_last_frame_usec() const { return last_usec.load(std::memory_order_relaxed); }
+	uint32_t get_average_frame_usec() const { return average_usec.load(std::memory_order_relaxed); }
+
+	GPUTimerSwitch();
+};
+
+#endif // GPU_TIMER_SWITCH_H
@@ -0,0 +1,374 @@
+/**************************************************************************/
+/*  logger_switch.cpp                                                     */
+/**************************************************************************/
+/*                         This file is part of:                          */
+/*                             GODOT ENGINE                               */
+/*                        https://godotengine.org                         */
+/**************************************************************************/
+/* Copyright (c) 2014-present Godot Engine contributors (see AUTHORS.md). */
+/* Copyright (c) 2007-2014 Juan Linietsky, Ariel Manzur.                  */
+/*                                                                        */
+/* Permission is hereby granted, free of charge, to any person obtaining  */
+/* a copy of this software and associated documentation files (the        */
+/* "Software"), to deal in the Software without restriction, including    */
+/* without limitation the rights to use, copy, modify, merge, publish,    */
+/* distribute, sublicense, and/or sell copies of the Software, and to     */
+/* permit persons to whom the Software is furnished to do so, subject to  */
+/* the following conditions:                                              */
+/*                                                                        */
+/* The above copyright notice and this permission notice shall be         */
+/* included in all copies or substantial portions of the Software.        */
+/*                                                                        */
+/* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,        */
+/* EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF     */
+/* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. */
+/* IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY   */
+/* CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,   */
+/* TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE      */
+/* SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.                 */
+/**************************************************************************/
+
+#include "logger_switch.h"
+
+#include "core/os/file_access.h"
+#include "core/os/thread.h"
+#include "switch_wrapper.h"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include <atomic>
+
+#define RING_SIZE 256 // records per thread, must be a power of two
+#define LINE_SIZE 512
+#define DRAIN_INTERVAL_NS 5000000ll
+
+struct TraceRecord {
+	u64 tick;
+	const char *function;
+	const char *format;
+	u64 thread_id;
+	uint8_t argc;
+	uint8_t sizes[LoggerSwitch::MAX_ARGS];
+	uint64_t args[LoggerSwitch::MAX_ARGS];
+};
+
+// Single producer (the owning thread), single consumer (the drain thread).
+struct TraceRing {
+	TraceRecord *records; // RING_SIZE of them, null while the ring is idle and released
+	std::atomic<uint32_t> head; // next slot to write, only moved by the producer
+	std::atomic<uint32_t> tail; // next slot to read, only moved by the consumer
+	std::atomic<uint32_t> dropped;
+	std::atomic<bool> in_use; // cleared when the owning thread exits, so the ring can be reused
+	TraceRing *next;
+};
+
+static std::atomic<TraceRing *> rings(nullptr);
+static __thread TraceRing *thread_ring = nullptr;
+static __thread bool thread_ring_released = false;
+static pthread_key_t ring_key;
+static pthread_once_t ring_key_once = PTHREAD_ONCE_INIT;
+
+static Thread drain_thread;
+static std::atomic<bool> drain_running(false);
+static std::atomic<bool> drain_exit(false);
+static int drain_sinks = 0;
+static FileAccess *drain_file = nullptr;
+
+// Runs as the thread exits. Other destructors may still trace, they must not
+// push into a ring another thread can take over by now, or claim a new one.
+static void _release_ring(void *p_ring) {
+	thread_ring = nullptr;
+	thread_ring_released = true;
+	((TraceRing *)p_ring)->in_use.store(false, std::memory_order_release);
+}
+
+static void _create_ring_key() {
+	pthread_key_create(&ring_key, _release_ring);
+}
+
+static TraceRing *_get_thread_ring() {
+	if (thread_ring || thread_ring_released) {
+		return thread_ring;
+	}
+
+	// Rings are never freed, reuse one left behind by a thread that exited.
+	TraceRing *ring = rings.load(std::memory_order_acquire);
+	for (; ring; ring = ring->next) {
+		bool expected = false;
+		if (ring->in_use.compare_exchange_strong(expected, true, std::memory_order_acq_rel)) {
+			break;
+		}
+	}
+
+	if (ring && !ring->records) {
+		ring->records = (TraceRecord *)memalloc(sizeof(TraceRecord) * RING_SIZE);
+		if (!ring->records) {
+			ring->in_use.store(false, std::memory_order_release);
+			return nullptr;
+		}
+	}
+
+	if (!ring) {
+		TraceRecord *records = (TraceRecord *)memalloc(sizeof(TraceRecord) * RING_SIZE);
+		ring = records ? (TraceRing *)memalloc(sizeof(TraceRing)) : nullptr;
+		if (!ring) {
+			if (records) {
+				memfree(records);
+			}
+			return nullptr;
+		}
+		ring->records = records;
+		ring->head.store(0);
+		ring->tail.store(0);
+		ring->dropped.store(0);
+		ring->in_use.store(true);
+		ring->next = rings.load(std::memory_order_relaxed);
+		while (!rings.compare_exchange_weak(ring->next, ring, std::memory_order_release, std::memory_order_relaxed)) {
+		}
+	}
+
+	pthread_once(&ring_key_once, _create_ring_key);
+	pthread_setspecific(ring_key, ring);
+	thread_ring = ring;
+	return ring;
+}
+
+static void _write_direct(const TraceRecord &p_record);
+
+static void _fill_record(TraceRecord &r_record, const char *p_function, const char *p_format, int p_argc, const uint64_t *p_args, const uint8_t *p_sizes) {
+	r_record.tick = armGetSystemTick();
+	r_record.function = p_function;
+	r_record.format = p_format;
+	svcGetThreadId(&r_record.thread_id, CUR_THREAD_HANDLE);
+	r_record.argc = p_argc;
+	for (int i = 0; i < p_argc; i++) {
+		r_record.args[i] = p_args[i];
+		r_record.sizes[i] = p_sizes[i];
+	}
+}
+
+void LoggerSwitch::_push(const char *p_function, const char *p_format, int p_argc, const uint64_t *p_args, const uint8_t *p_sizes) {
+	TraceRing *ring = _get_thread_ring();
+	if (!ring) {
+		// The thread is exiting, or no ring could be allocated.
+		TraceRecord record;
+		_fill_record(record, p_function, p_format, p_argc, p_args, p_sizes);
+		_write_direct(record);
+		return;
+	}
+
+	uint32_t head = ring->head.load(std::memory_order_relaxed);
+	if (head - ring->tail.load(std::memory_order_acquire) >= RING_SIZE) {
+		ring->dropped.fetch_add(1, std::memory_order_relaxed);
+		return;
+	}
+
+	_fill_record(ring->records[head & (RING_SIZE - 1)], p_function, p_format, p_argc, p_args, p_sizes);
+	ring->head.store(head + 1, std::memory_order_release);
+}
+
+// printf-style formatting of a record, done on the drain thread unless the
+// record bypasses it. Integer conversions use the argument's original width.
+static int _format_record(const TraceRecord &p_record, char *r_line, int p_size) {
+	uint64_t usec = armTicksToNs(p_record.tick) / 1000;
+	int len = snprintf(r_line, p_size, "[%llu.%06llu] [%llx] %s: ", (unsigned long long)(usec / 1000000), (unsigned long long)(usec % 1000000), (unsigned long long)p_record.thread_id, p_record.function);
+
+	int arg = 0;
+	const char *c = p_record.format;
+	while (*c && len < p_size - 1) {
+		if (*c != '%') {
+			r_line[len++] = *c++;
+			continue;
+		}
+		if (c[1] == '%') {
+			r_line[len++] = '%';
+			c += 2;
+			continue;
+		}
+
+		// Keep flags, width and precision, replace the length modifier with our own.
+		char spec[16];
+		int spec_len = 0;
+		spec[spec_len++] = *c++;
+		while (*c && strchr("-+ #0123456789.", *c) && spec_len < 10) {
+			spec[spec_len++] = *c++;
+		}
+		while (*c && strchr("hlLqjzt", *c)) {
+			c++;
+		}
+		char conversion = *c;
+		if (!conversion) {
+			break;
+		}
+		c++;
+
+		uint64_t value = arg < p_record.argc ? p_record.args[arg] : 0;
+		bool narrow = arg < p_record.argc && p_record.sizes[arg] <= 4;
+		arg++;
+
+		int written = 0;
+		switch (conversion) {
+			case 'd':
+			case 'i': {
+				spec[spec_len++] = 'l';
+				spec[spec_len++] = 'l';
+				spec[spec_len++] = conversion;
+				spec[spec_len] = 0;
+				written = snprintf(r_line + len, p_size - len, spec, (long long)(narrow ? (int64_t)(int32_t)value : (int64_t)value));
+			} break;
+			case 'u':
+			case 'x':
+			case 'X':
+			case 'o': {
+				spec[spec_len++] = 'l';
+				spec[spec_len++] = 'l';
+				spec[spec_len++] = conversion;
+				spec[spec_len] = 0;
+				written = snprintf(r_line + len, p_size - len, spec, (unsigned long long)(narrow ? (value & 0xFFFFFFFFull) : value));
+			} break;
+			case 'c':
+			case 's':
+			case 'p': {
+				spec[spec_len++] = conversion;
+				spec[spec_len] = 0;
+				if (conversion == 'c') {
+					written = snprintf(r_line + len, p_size - len, spec, (int)value);
+				} else if (conversion == 's') {
+					written = snprintf(r_line + len, p_size - len, spec, value ? (const char *)(uintptr_t)value : "(null)");
+				} else {
+					written = snprintf(r_line + len, p_size - len, spec, (void *)(uintptr_t)value);
+				}
+			} break;
+			default: {
+				written = snprintf(r_line + len, p_size - len, "%%%c", conversion);
+			} break;
+		}
+		if (written > 0) {
+			len = MIN(len + written, p_size - 1);
+		}
+	}
+
+	// Formats often end with their own newline already.
+	if (len > 0 && r_line[len - 1] == '\n') {
+		len--;
+	}
+	len = MIN(len, p_size - 2);
+	r_line[len++] = '\n';
+	r_line[len] = 0;
+	return len;
+}
+
+// Bypasses the drain thread, only stdout is safe to write from any thread.
+static void _write_direct(const TraceRecord &p_record) {
+	if (drain_sinks & LoggerSwitch::SINK_STDOUT) {
+		char line[LINE_SIZE];
+		int len = _format_record(p_record, line, sizeof(line));
+		fwrite(line, 1, len, stdout);
+		fflush(stdout);
+	}
+}
+
+static bool _drain() {
+	bool drained = false;
+	char line[LINE_SIZE];
+
+	for (TraceRing *ring = rings.load(std::memory_order_acquire); ring; ring = ring->next) {
+		uint32_t tail = ring->tail.load(std::memory_order_relaxed);
+		uint32_t head = ring->head.load(std::memory_order_acquire);
+
+		uint32_t dropped = ring->dropped.exchange(0, std::memory_order_relaxed);
+		if (dropped) {
+			int len = snprintf(line, sizeof(line), "[trace] %u records dropped, the log can't keep up.\n", dropped);
+			if (drain_sinks & LoggerSwitch::SINK_STDOUT) {
+				fwrite(line, 1, len, stdout);
+			}
+			if ((drain_sinks & LoggerSwitch::SINK_FILE) && drain_file) {
+				drain_file->store_buffer((const uint8_t *)line, len);
+			}
+		}
+
+		for (; tail != head; tail++) {
+			int len = _format_record(ring->records[tail & (RING_SIZE - 1)], line, sizeof(line));
+			// Free the slot before the (possibly slow) write.
+			ring->tail.store(tail + 1, std::memory_order_release);
+
+			if (drain_sinks & LoggerSwitch::SINK_STDOUT) {
+				fwrite(line, 1, len, stdout);
+			}
+			if ((drain_sinks & LoggerSwitch::SINK_FILE) && drain_file) {
+				drain_file->store_buffer((const uint8_t *)line, len);
+			}
+			drained = true;
+		}
+	}
+
+	if (drained) {
+		if (drain_sinks & LoggerSwitch::SINK_STDOUT) {
+			fflush(stdout);
+		}
+		if (drain_file) {
+			drain_file->flush();
+		}
+	}
+	return drained;
+}
+
+static void _drain_thread_func(void *p_udata) {
+	while (!drain_exit.load(std::memory_order_acquire)) {
+		if (!_drain()) {
+			svcSleepThread(DRAIN_INTERVAL_NS);
+		}
+	}
+	_drain();
+}
+
+void LoggerSwitch::start(int p_sinks, const String &p_file_path) {
+	if (drain_running.load()) {
+		return;
+	}
+
+	drain_sinks = p_sinks;
+	if (p_sinks & SINK_FILE) {
+		drain_file = FileAccess::open(p_file_path, FileAccess::WRITE);
+		if (!drain_file) {
+			drain_sinks &= ~SINK_FILE;
+		}
+	}
+
+	drain_exit.store(false);
+	drain_running.store(true);
+	drain_thread.start(_drain_thread_func, nullptr);
+}
+
+void LoggerSwitch::release_idle_buffers() {
+	for (TraceRing *ring = rings.load(std::memory_order_acquire); ring; ring = ring->next) {
+		// Claiming the ring keeps threads from taking it over meanwhile. The
+		// drain thread only reads records between tail and head.
+		bool expected = false;
+		if (!ring->in_use.compare_exchange_strong(expected, true, std::memory_order_acq_rel)) {
+			continue;
+		}
+		if (ring->records && ring->tail.load(std::memory_order_acquire) == ring->head.load(std::memory_order_relaxed)) {
+			memfree(ring->records);
+			ring->records = nullptr;
+		}
+		ring->in_use.store(false, std::memory_order_release);
+	}
+}
+
+void LoggerSwitch::stop() {
+	if (!drain_running.load()) {
+		return;
+	}
+
+	drain_exit.store(true, std::memory_order_release);
+	drain_thread.wait_to_finish();
+	drain_running.store(false);
+
+	if (drain_file) {
+		drain_file->close();
+		memdelete(drain_file);
+		drain_file = nullptr;
+	}
+}
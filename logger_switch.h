@@ -0,0 +1,90 @@
+/**************************************************************************/
+/*  logger_switch.h                                                       */
+/**************************************************************************/
+/*                         This file is part of:                          */
+/*                             GODOT ENGINE                               */
+/*                        https://godotengine.org                         */
+/**************************************************************************/
+/* Copyright (c) 2014-present Godot Engine contributors (see AUTHORS.md). */
+/* Copyright (c) 2007-2014 Juan Linietsky, Ariel Manzur.                  */
+/*                                                                        */
+/* Permission is hereby granted, free of charge, to any person obtaining  */
+/* a copy of this software and associated documentation files (the        */
+/* "Software"), to deal in the Software without restriction, including    */
+/* without limitation the rights to use, copy, modify, merge, publish,    */
+/* distribute, sublicense, and/or sell copies of the Software, and to     */
+/* permit persons to whom the Software is furnished to do so, subject to  */
+/* the following conditions:                                              */
+/*                                                                        */
+/* The above copyright notice and this permission notice shall be         */
+/* included in all copies or substantial portions of the Software.        */
+/*                                                                        */
+/* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,        */
+/* EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF     */
+/* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. */
+/* IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY   */
+/* CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,   */
+/* TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE      */
+/* SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.                 */
+/**************************************************************************/
+
+#ifndef LOGGER_SWITCH_H
+#define LOGGER_SWITCH_H
+
+#include "core/ustring.h"
+
+#include <stdint.h>
+#include <type_traits>
+
+// Hot-path trace logging. A call only copies the format pointer and raw
+// arguments into a per-thread ring; a background thread formats the records
+// and writes them to stdout (nxlink), a file, or both, so a slow host never
+// stalls the caller. Arguments must be integers, pointers or string literals,
+// since strings are only dereferenced when the record is drained.
+class LoggerSwitch {
+public:
+	enum {
+		SINK_STDOUT = 1,
+		SINK_FILE = 2,
+	};
+
+	enum {
+		MAX_ARGS = 6,
+	};
+
+	template <typename... Args>
+	static void log(const char *p_function, const char *p_format, Args... p_args) {
+		static_assert(sizeof...(Args) <= MAX_ARGS, "Too many arguments for a trace record.");
+		const uint64_t args[] = { 0, _to_arg(p_args)... };
+		const uint8_t sizes[] = { 0, (uint8_t)sizeof(p_args)... };
+		_push(p_function, p_format, sizeof...(Args), args + 1, sizes + 1);
+	}
+
+	// Starts draining to the given sinks, records logged before this are kept.
+	static void start(int p_sinks, const String &p_file_path);
+	// Drains what is left and stops the background thread.
+	static void stop();
+	// Frees the records of rings left behind by exited threads once drained.
+	static void release_idle_buffers();
+
+private:
+	template <typename T>
+	static uint64_t _to_arg(T p_value) {
+		static_assert(std::is_integral<T>::value || std::is_enum<T>::value, "Only integers, pointers and string literals can be traced.");
+		return (uint64_t)(int64_t)p_value;
+	}
+	template <typename T>
+	static uint64_t _to_arg(T *p_value) {
+		return (uint64_t)(uintptr_t)p_value;
+	}
+
+	static void _push(const char *p_function, const char *p_format, int p_argc, const uint64_t *p_args, const uint8_t *p_sizes);
+};
+
+#ifdef DEBUG_ENABLED
+#define TRACE(fmt, ...) LoggerSwitch::log(__PRETTY_FUNCTION__, fmt, ##__VA_ARGS__)
+#else
+#define TRACE(fmt, ...) ((void)0)
+#endif
+
+#endif // LOGGER_SWITCH_H
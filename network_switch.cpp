@@ -0,0 +1,88 @@
+/**************************************************************************/
+/*  network_switch.cpp                                                    */
+/**************************************************************************/
+/*                         This file is part of:                          */
+/*                             GODOT ENGINE                               */
+/*                        https://godotengine.org                         */
+/**************************************************************************/
+/* Copyright (c) 2014-present Godot Engine contributors (see AUTHORS.md). */
+/* Copyright (c) 2007-2014 Juan Linietsky, Ariel Manzur.                  */
+/*                                                                        */
+/* Permission is hereby granted, free of charge, to any person obtaining  */
+/* a copy of this software and associated documentation files (the        */
+/* "Software"), to deal in the Software without restriction, including    */
+/* without limitation the rights to use, copy, modify, merge, publish,    */
+/* distribute, sublicense, and/or sell copies of the Software, and to     */
+/* permit persons to whom the Software is furnished to do so, subject to  */
+/* the following conditions:                                              */
+/*                                                                        */
+/* The above copyright notice and this permission notice shall be         */
+/* included in all copies or substantial portions of the Software.        */
+/*                                                                        */
+/* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,        */
+/* EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF     */
+/* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. */
+/* IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY   */
+/* CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,   */
+/* TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE      */
+/* SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.                 */
+/**************************************************************************/
+
+#include "network_switch.h"
+
+#include "switch_wrapper.h"
+
+#include <netdb.h>
+#include <sys/socket.h>
+#include <atomic>
+
+extern "C" {
+int __real_socket(int p_domain, int p_type, int p_protocol);
+int __real_getaddrinfo(const char *p_node, const char *p_service, const struct addrinfo *p_hints, struct addrinfo **r_res);
+struct hostent *__real_gethostbyname(const char *p_name);
+
+int __wrap_socket(int p_domain, int p_type, int p_protocol);
+int __wrap_getaddrinfo(const char *p_node, const char *p_service, const struct addrinfo *p_hints, struct addrinfo **r_res);
+struct hostent *__wrap_gethostbyname(const char *p_name);
+}
+
+static std::atomic<bool> initialized(false);
+static LibnxMutex init_mutex = 0;
+
+void network_switch_ensure_initialized() {
+	if (initialized.load(std::memory_order_acquire)) {
+		return;
+	}
+
+	mutexLock(&init_mutex);
+	if (!initialized.load(std::memory_order_relaxed)) {
+		if (R_SUCCEEDED(socketInitializeDefault())) {
+			initialized.store(true, std::memory_order_release);
+		}
+	}
+	mutexUnlock(&init_mutex);
+}
+
+void network_switch_finalize() {
+	mutexLock(&init_mutex);
+	if (initialized.load(std::memory_order_relaxed)) {
+		socketExit();
+		initialized.store(false, std::memory_order_release);
+	}
+	mutexUnlock(&init_mutex);
+}
+
+int __wrap_socket(int p_domain, int p_type, int p_protocol) {
+	network_switch_ensure_initialized();
+	return __real_socket(p_domain, p_type, p_protocol);
+}
+
+int __wrap_getaddrinfo(const char *p_node, const char *p_service, const struct addrinfo *p_hints, struct addrinfo **r_res) {
+	network_switch_ensure_initialized();
+	return __real_getaddrinfo(p_node, p_service, p_hints, r_res);
+}
+
+struct hostent *__wrap_gethostbyname(const char *p_name) {
+	network_switch_ensure_initialized();
+	return __real_gethostbyname(p_name);
+}
@@ -30,7 +30,16 @@
 
 #include "os_switch.h"
 #include "context_gl_switch_egl.h"
+#include "allocator_switch.h"
+#include "file_access_switch.h"
+#include "pack_source_switch.h"
+#include "logger_switch.h"
+#include "shader_cache_switch.h"
+#include "splash_switch.h"
+#include "startup_timeline_switch.h"
 #include "switch_wrapper.h"
+#include "thread_switch.h"
+#include "ticks_switch.h"
 
 #include "drivers/gles2/rasterizer_gles2.h"
 #include "drivers/gles3/rasterizer_gles3.h"
@@ -43,29 +52,32 @@
 #include "servers/audio_server.h"
 #include "servers/visual/visual_server_wrap_mt.h"
 
+#include "core/io/config_file.h"
 #include "core/os/keyboard.h"
+#include "core/project_settings.h"
 
 #include <inttypes.h>
+#include <malloc.h>
 #include <netinet/in.h>
 #include <stdio.h>
+#include <string.h>
 
-#define ENABLE_NXLINK
+// Heap bounds set up by libnx for newlib's sbrk.
+extern "C" char *fake_heap_start;
+extern "C" char *fake_heap_end;
 
-#ifndef ENABLE_NXLINK
-#define TRACE(fmt, ...) ((void)0)
-#else
-#include <unistd.h>
-#define TRACE(fmt, ...) printf("%s: " fmt "\n", __PRETTY_FUNCTION__, ##__VA_ARGS__)
-#endif
+static uint64_t ticks_to_usec_factor = 0;
 
 void OS_Switch::initialize_core() {
 #if !defined(NO_THREADS)
 	init_thread_posix();
+	ThreadSwitch::initialize();
 #endif
+	ThreadSwitch::apply(ThreadSwitch::ROLE_MAIN);
 
-	FileAccess::make_default<FileAccessUnix>(FileAccess::ACCESS_RESOURCES);
-	FileAccess::make_default<FileAccessUnix>(FileAccess::ACCESS_USERDATA);
-	FileAccess::make_default<FileAccessUnix>(FileAccess::ACCESS_FILESYSTEM);
+	FileAccess::make_default<FileAccessSwitch>(FileAccess::ACCESS_RESOURCES);
+	FileAccess::make_default<FileAccessSwitch>(FileAccess::ACCESS_USERDATA);
+	FileAccess::make_default<FileAccessSwitch>(FileAccess::ACCESS_FILESYSTEM);
 	DirAccess::make_default<DirAccessUnix>(DirAccess::ACCESS_RESOURCES);
 	DirAccess::make_default<DirAccessUnix>(DirAccess::ACCESS_USERDATA);
 	DirAccess::make_default<DirAccessUnix>(DirAccess::ACCESS_FILESYSTEM);
@@ -76,6 +88,19 @@ void OS_Switch::initialize_core() {
 #endif
 }
 
+void OS_Switch::release_rendering_thread() {
+#ifdef OPENGL_ENABLED
+	gl_context->release_current();
+#endif
+}
+
+void OS_Switch::make_rendering_thread() {
+	ThreadSwitch::apply(ThreadSwitch::ROLE_RENDER);
+#ifdef OPENGL_ENABLED
+	gl_context->make_current();
+#endif
+}
+
 void OS_Switch::swap_buffers() {
 #ifdef OPENGL_ENABLED
 	gl_context->swap_buffers();
@@ -83,6 +108,24 @@ void OS_Switch::swap_buffers() {
 }
 
 Error OS_Switch::initialize(const VideoMode &p_desired, int p_video_driver, int p_audio_driver) {
+	ThreadSwitch::load_settings();
+	ThreadSwitch::apply(ThreadSwitch::ROLE_MAIN);
+
+	// With binary_format/embed_pck the main pack is in romfs. The engine's own
+	// source has indexed it already, and sources can't be put ahead of it, so
+	// index it again with replace_files to route its files through the shared handle.
+	if (!PackedData::get_singleton()->is_disabled() && FileAccess::exists("romfs:/game.pck")) {
+		PackSourceSwitch *romfs_pack = memnew(PackSourceSwitch);
+		PackedData::get_singleton()->add_pack_source(romfs_pack);
+		romfs_pack->try_open_pack("romfs:/game.pck", true, 0);
+	}
+
+#ifdef DEBUG_ENABLED
+	int trace_output = GLOBAL_DEF("debug/settings/switch/trace_output", LoggerSwitch::SINK_STDOUT);
+	ProjectSettings::get_singleton()->set_custom_property_info("debug/settings/switch/trace_output", PropertyInfo(Variant::INT, "debug/settings/switch/trace_output", PROPERTY_HINT_ENUM, "None,Stdout,File,Stdout and File"));
+	LoggerSwitch::start(trace_output, get_user_data_dir().plus_file("trace.log"));
+#endif
+
 #ifdef OPENGL_ENABLED
 	bool gles3_context = true;
 	if (p_video_driver == VIDEO_DRIVER_GLES2) {
@@ -92,57 +135,84 @@ Error OS_Switch::initialize(const VideoMode &p_desired, int p_video_driver, int
 	bool editor = Engine::get_singleton()->is_editor_hint();
 	bool gl_initialization_error = false;
 
-	gl_context = NULL;
-	while (!gl_context) {
-		gl_context = memnew(ContextGLSwitchEGL(gles3_context));
-
-		if (gl_context->initialize() != OK) {
-			memdelete(gl_context);
-			gl_context = NULL;
-
-			if (GLOBAL_GET("rendering/quality/driver/fallback_to_gles2") || editor) {
-				if (p_video_driver == VIDEO_DRIVER_GLES2) {
-					gl_initialization_error = true;
-					break;
-				}
-
-				p_video_driver = VIDEO_DRIVER_GLES2;
-				gles3_context = false;
-			} else {
-				gl_initialization_error = true;
-				break;
-			}
-		}
+	// The engine renders into its own buffers and blits them to the window, so the
+	// window only needs what is drawn to it directly. MSAA here is separate from
+	// rendering/quality/filters/msaa, which applies to viewports.
+	int msaa = GLOBAL_DEF("display/window/switch/msaa", 0);
+	ProjectSettings::get_singleton()->set_custom_property_info("display/window/switch/msaa", PropertyInfo(Variant::INT, "display/window/switch/msaa", PROPERTY_HINT_ENUM, "Disabled,2x,4x,8x"));
+	int depth_stencil = GLOBAL_DEF("display/window/switch/depth_stencil", 0);
+	ProjectSettings::get_singleton()->set_custom_property_info("display/window/switch/depth_stencil", PropertyInfo(Variant::INT, "display/window/switch/depth_stencil", PROPERTY_HINT_ENUM, "Auto,None,Depth 16,Depth 24,Depth 24 + Stencil 8"));
+	bool srgb = GLOBAL_DEF("display/window/switch/srgb_framebuffer", false);
+	// Triple buffering absorbs GPU spikes, double buffering keeps input latency down.
+	int buffering = GLOBAL_DEF("display/window/switch/buffering", 1);
+	ProjectSettings::get_singleton()->set_custom_property_info("display/window/switch/buffering", PropertyInfo(Variant::INT, "display/window/switch/buffering", PROPERTY_HINT_ENUM, "Double,Triple"));
+
+	if (depth_stencil == 0) {
+		// 2D-only projects never depth test against the window.
+		int usage = ProjectSettings::get_singleton()->has_setting("rendering/quality/intended_usage/framebuffer_allocation") ? (int)GLOBAL_GET("rendering/quality/intended_usage/framebuffer_allocation") : 2;
+		depth_stencil = usage < 2 ? 1 : 4;
 	}
-
-	while (true) {
-		if (gles3_context) {
-			if (RasterizerGLES3::is_viable() == OK) {
-				RasterizerGLES3::register_config();
-				RasterizerGLES3::make_current();
-				break;
-			} else {
-				if (GLOBAL_GET("rendering/quality/driver/fallback_to_gles2") || editor) {
-					p_video_driver = VIDEO_DRIVER_GLES2;
-					gles3_context = false;
-					continue;
-				} else {
-					gl_initialization_error = true;
-					break;
-				}
-			}
+	static const int depth_bits[] = { 24, 0, 16, 24, 24 };
+	static const int stencil_bits[] = { 8, 0, 0, 0, 8 };
+	depth_stencil = CLAMP(depth_stencil, 0, 4);
+
+	bool can_fallback = GLOBAL_GET("rendering/quality/driver/fallback_to_gles2") || editor;
+
+	// Whether GLES3 worked on this system version last time, so a failing probe
+	// isn't repeated on every launch.
+	String gl_caps_path = get_user_data_dir().plus_file("gl_capabilities.cfg");
+	Ref<ConfigFile> gl_caps;
+	gl_caps.instance();
+	bool gl_caps_valid = gl_caps->load(gl_caps_path) == OK && (int)gl_caps->get_value("gl", "hos_version", 0) == (int)hosversionGet();
+	if (gles3_context && can_fallback && gl_caps_valid && !(bool)gl_caps->get_value("gl", "gles3_viable", true)) {
+		p_video_driver = VIDEO_DRIVER_GLES2;
+		gles3_context = false;
+	}
+	bool probe_gles3 = gles3_context;
+
+	StartupTimelineSwitch::begin("GL context");
+	gl_context = memnew(ContextGLSwitchEGL(gles3_context));
+	gl_context->set_msaa_samples(msaa > 0 ? 1 << msaa : 0);
+	gl_context->set_depth_stencil_bits(depth_bits[depth_stencil], stencil_bits[depth_stencil]);
+	gl_context->set_use_srgb(srgb);
+	gl_context->set_swap_chain_depth(buffering == 0 ? 2 : 3);
+
+	StartupTimelineSwitch::begin(gles3_context ? "ContextGLSwitchEGL::initialize (GLES3)" : "ContextGLSwitchEGL::initialize (GLES2)");
+	Error context_err = gl_context->initialize();
+	if (gles3_context && (context_err != OK || RasterizerGLES3::is_viable() != OK) && can_fallback) {
+		// Only the context is replaced, the display stays up.
+		p_video_driver = VIDEO_DRIVER_GLES2;
+		gles3_context = false;
+		context_err = gl_context->fallback_to_gles2();
+	}
+	StartupTimelineSwitch::end();
+
+	if (context_err != OK) {
+		gl_initialization_error = true;
+	} else if (gles3_context) {
+		if (RasterizerGLES3::is_viable() == OK) {
+			RasterizerGLES3::register_config();
+			RasterizerGLES3::make_current();
 		} else {
-			if (RasterizerGLES2::is_viable() == OK) {
-				RasterizerGLES2::register_config();
-				RasterizerGLES2::make_current();
-				break;
-			} else {
-				gl_initialization_error = true;
-				break;
-			}
+			gl_initialization_error = true;
 		}
+	} else {
+		if (RasterizerGLES2::is_viable() == OK) {
+			RasterizerGLES2::register_config();
+			RasterizerGLES2::make_current();
+		} else {
+			gl_initialization_error = true;
+		}
+	}
+
+	if (probe_gles3 && !gl_initialization_error && (!gl_caps_valid || (bool)gl_caps->get_value("gl", "gles3_viable", true) != gles3_context)) {
+		gl_caps->set_value("gl", "hos_version", (int)hosversionGet());
+		gl_caps->set_value("gl", "gles3_viable", gles3_context);
+		gl_caps->save(gl_caps_path);
 	}
 
+	StartupTimelineSwitch::end();
+
 	if (gl_initialization_error) {
 		OS::get_singleton()->alert("Your firmware does not support any of the supported OpenGL versions.\n"
 								   "Please update your custom firmware to install the latest OpenGL driver.",
@@ -153,14 +223,25 @@ Error OS_Switch::initialize(const VideoMode &p_desired, int p_video_driver, int
 	video_driver_index = p_video_driver;
 
 	gl_context->set_use_vsync(current_videomode.use_vsync);
+
+	const char *gl_extensions = (const char *)glGetString(GL_EXTENSIONS);
+	astc_supported = gl_extensions && strstr(gl_extensions, "GL_KHR_texture_compression_astc_ldr");
+
+	ShaderCacheSwitch::initialize(gles3_context, gl_context);
+	add_low_memory_callback(ShaderCacheSwitch::release_memory);
 #endif
+	add_low_memory_callback(LoggerSwitch::release_idle_buffers);
+	// The GL context takes the window over from the boot splash, unless it failed to.
+	add_low_memory_callback(splash_switch_close);
 
+	StartupTimelineSwitch::begin("VisualServer::init");
 	visual_server = memnew(VisualServerRaster);
 	if (get_render_thread_mode() != RENDER_THREAD_UNSAFE) {
 		visual_server = memnew(VisualServerWrapMT(visual_server, get_render_thread_mode() == RENDER_SEPARATE_THREAD));
 	}
 
 	visual_server->init();
+	StartupTimelineSwitch::end();
 
 	input = memnew(InputDefault);
 	input->set_emulate_mouse_from_touch(true);
@@ -170,11 +251,24 @@ Error OS_Switch::initialize(const VideoMode &p_desired, int p_video_driver, int
 	}
 	joypad = memnew(JoypadSwitch(input));
 
-	if (R_SUCCEEDED(psmInitialize())) {
-		OS_Switch::psm_initialized = true;
-	}
+	power_manager = memnew(PowerSwitch);
+
+	low_memory_threshold = (uint64_t)(int)GLOBAL_DEF("memory/limits/switch/low_memory_threshold_mb", 32) << 20;
+	ProjectSettings::get_singleton()->set_custom_property_info("memory/limits/switch/low_memory_threshold_mb", PropertyInfo(Variant::INT, "memory/limits/switch/low_memory_threshold_mb", PROPERTY_HINT_RANGE, "0,512,1,or_greater"));
 
+	power_saving.enabled = GLOBAL_DEF("application/run/switch/power_saving/enabled", false);
+	power_saving.low_percent = GLOBAL_DEF("application/run/switch/power_saving/low_battery_percent", power_saving.low_percent);
+	ProjectSettings::get_singleton()->set_custom_property_info("application/run/switch/power_saving/low_battery_percent", PropertyInfo(Variant::INT, "application/run/switch/power_saving/low_battery_percent", PROPERTY_HINT_RANGE, "0,100,1"));
+	power_saving.critical_percent = GLOBAL_DEF("application/run/switch/power_saving/critical_battery_percent", power_saving.critical_percent);
+	ProjectSettings::get_singleton()->set_custom_property_info("application/run/switch/power_saving/critical_battery_percent", PropertyInfo(Variant::INT, "application/run/switch/power_saving/critical_battery_percent", PROPERTY_HINT_RANGE, "0,100,1"));
+	power_saving.low_target_fps = GLOBAL_DEF("application/run/switch/power_saving/low_battery_target_fps", power_saving.low_target_fps);
+	power_saving.critical_target_fps = GLOBAL_DEF("application/run/switch/power_saving/critical_battery_target_fps", power_saving.critical_target_fps);
+
+	StartupTimelineSwitch::begin("AudioDriverManager::initialize");
 	AudioDriverManager::initialize(p_audio_driver);
+	StartupTimelineSwitch::end();
+
+	appletHook(&applet_hook_cookie, _applet_hook, this);
 
 	return OK;
 }
@@ -191,24 +285,37 @@ void OS_Switch::delete_main_loop() {
 }
 
 void OS_Switch::finalize() {
+	appletUnhook(&applet_hook_cookie);
+
+	_sample_memory_usage();
+	print_line("Peak memory usage: " + String::humanize_size(memory_peak_usage.load()) + " of " + String::humanize_size(get_memory_info().heap_total) + " heap");
+
 	NintendoSwitch::get_singleton()->cleanup();
 
 	memdelete(input);
 	memdelete(joypad);
 	visual_server->finish();
 	memdelete(visual_server);
+#ifdef OPENGL_ENABLED
+	ShaderCacheSwitch::finalize();
+#endif
 	memdelete(gl_context);
-	psmExit();
+	memdelete(power_manager);
+	power_manager = nullptr;
 }
 
 void OS_Switch::finalize_core() {
+	LoggerSwitch::stop();
 }
 
 bool OS_Switch::_check_internal_feature_support(const String &p_feature) {
 	if (p_feature == "mobile") {
-		//TODO support etc2 only if GLES3 driver is selected
 		return true;
 	}
+	// etc and etc2 are reported by the rasterizer, depending on the driver in use.
+	if (p_feature == "astc") {
+		return astc_supported;
+	}
 	return false;
 }
 
@@ -237,13 +344,6 @@ OS::VideoMode OS_Switch::get_video_mode(int p_screen) const {
 
 void OS_Switch::get_fullscreen_mode_list(List<OS::VideoMode> *p_list, int p_screen) const {}
 
-OS::RenderThreadMode OS_Switch::get_render_thread_mode() const {
-	if (OS::get_render_thread_mode() == OS::RenderThreadMode::RENDER_SEPARATE_THREAD) {
-		return OS::RENDER_THREAD_SAFE;
-	}
-	return OS::get_render_thread_mode();
-}
-
 int OS_Switch::get_current_video_driver() const {
 	return video_driver_index;
 }
@@ -305,55 +405,76 @@ MainLoop *OS_Switch::get_main_loop() const {
 	return main_loop;
 }
 
-/// From os_unix.cpp
-OS::Date OS_Switch::get_date(bool utc) const {
+// The system time zone only changes from the HOME menu settings, so it is
+// refreshed when we regain focus and otherwise at most once a minute.
+#define TIME_ZONE_REFRESH_USEC 60000000
+
+static void _get_tm(bool p_utc, struct tm &r_tm) {
 	time_t t = time(nullptr);
-	struct tm lt;
-	if (utc) {
-		gmtime_r(&t, &lt);
+	if (p_utc) {
+		gmtime_r(&t, &r_tm);
 	} else {
-		localtime_r(&t, &lt);
+		localtime_r(&t, &r_tm);
 	}
-	Date ret;
-	ret.year = 1900 + lt.tm_year;
+}
+
+/// From os_unix.cpp
+static OS::Date _tm_to_date(const struct tm &p_tm) {
+	OS::Date ret;
+	ret.year = 1900 + p_tm.tm_year;
 	// Index starting at 1 to match OS_Unix::get_date
 	//   and Windows SYSTEMTIME and tm_mon follows the typical structure
 	//   of 0-11, noted here: http://www.cplusplus.com/reference/ctime/tm/
-	ret.month = (Month)(lt.tm_mon + 1);
-	ret.day = lt.tm_mday;
-	ret.weekday = (Weekday)lt.tm_wday;
-	ret.dst = lt.tm_isdst;
+	ret.month = (OS::Month)(p_tm.tm_mon + 1);
+	ret.day = p_tm.tm_mday;
+	ret.weekday = (OS::Weekday)p_tm.tm_wday;
+	ret.dst = p_tm.tm_isdst;
+	return ret;
+}
 
+static OS::Time _tm_to_time(const struct tm &p_tm) {
+	OS::Time ret;
+	ret.hour = p_tm.tm_hour;
+	ret.min = p_tm.tm_min;
+	ret.sec = p_tm.tm_sec;
 	return ret;
 }
 
-/// From os_unix.cpp
+OS::Date OS_Switch::get_date(bool utc) const {
+	struct tm lt;
+	_get_tm(utc, lt);
+	return _tm_to_date(lt);
+}
+
 OS::Time OS_Switch::get_time(bool utc) const {
-	time_t t = time(nullptr);
 	struct tm lt;
-	if (utc) {
-		gmtime_r(&t, &lt);
-	} else {
-		localtime_r(&t, &lt);
-	}
-	Time ret;
-	ret.hour = lt.tm_hour;
-	ret.min = lt.tm_min;
-	ret.sec = lt.tm_sec;
-	get_time_zone_info();
-	return ret;
+	_get_tm(utc, lt);
+	return _tm_to_time(lt);
+}
+
+// Both halves come from the same time() read, so they can't straddle midnight.
+void OS_Switch::get_date_time(bool p_utc, Date &r_date, Time &r_time) const {
+	struct tm lt;
+	_get_tm(p_utc, lt);
+	r_date = _tm_to_date(lt);
+	r_time = _tm_to_time(lt);
 }
 
 /// From os_unix.cpp
 OS::TimeZoneInfo OS_Switch::get_time_zone_info() const {
-	time_t t = time(nullptr);
+	MutexLock lock(time_zone_mutex);
+
+	uint64_t now = get_ticks_usec();
+	if (time_zone_expiry_usec != 0 && now < time_zone_expiry_usec) {
+		return time_zone_info;
+	}
+
 	struct tm lt;
-	localtime_r(&t, &lt);
+	_get_tm(false, lt);
 	char name[16];
 	strftime(name, 16, "%Z", &lt);
 	name[15] = 0;
-	TimeZoneInfo ret;
-	ret.name = name;
+	time_zone_info.name = name;
 
 	char bias_buf[16];
 	strftime(bias_buf, 16, "%z", &lt);
@@ -365,25 +486,142 @@ OS::TimeZoneInfo OS_Switch::get_time_zone_info() const {
 	int hour = (int)bias / 100;
 	int minutes = bias % 100;
 	if (bias < 0) {
-		ret.bias = hour * 60 - minutes;
+		time_zone_info.bias = hour * 60 - minutes;
 	} else {
-		ret.bias = hour * 60 + minutes;
+		time_zone_info.bias = hour * 60 + minutes;
 	}
 
-	return ret;
+	time_zone_expiry_usec = now + TIME_ZONE_REFRESH_USEC;
+	return time_zone_info;
 }
 
 void OS_Switch::delay_usec(uint32_t p_usec) const {
 	svcSleepThread((int64_t)p_usec * 1000ll);
 }
 
+uint64_t OS_Switch::_get_raw_ticks_usec() const {
+	return ticks_switch_to_usec(armGetSystemTick(), ticks_to_usec_factor);
+}
+
+// Set by run() on the main thread right before Main::iteration(), which takes
+// the frame's time from its first clock read.
+static __thread bool reading_frame_ticks = false;
+
 uint64_t OS_Switch::get_ticks_usec() const {
-	static u64 tick_freq = armGetSystemTickFreq();
-	return armGetSystemTick() / (tick_freq / 1000000);
+	uint64_t ticks = _get_raw_ticks_usec();
+	if (reading_frame_ticks) {
+		// Only the frame delta skips time out of focus, the clock stays monotonic for everyone else.
+		reading_frame_ticks = false;
+		ticks -= suspended_usec.load(std::memory_order_relaxed);
+	}
+	return ticks;
+}
+
+OS_Switch::FrameTiming OS_Switch::get_frame_timing() const {
+	FrameTiming timing = {};
+#ifdef OPENGL_ENABLED
+	if (gl_context) {
+		timing.swap_chain_depth = gl_context->get_swap_chain_depth();
+		timing.present_queue_depth = gl_context->get_present_queue_depth();
+		timing.cpu_frame_usec = gl_context->get_cpu_frame_usec();
+		timing.present_wait_usec = gl_context->get_present_wait_usec();
+		timing.gpu_timing_supported = gl_context->get_gpu_timer().is_supported();
+		timing.gpu_frame_usec = gl_context->get_gpu_timer().get_last_frame_usec();
+		timing.gpu_frame_average_usec = gl_context->get_gpu_timer().get_average_frame_usec();
+	}
+#endif
+	return timing;
+}
+
+// The arena's region is cut off the top of newlib's heap.
+static void get_heap_usage(const AllocatorSwitch::Stats &p_arena, uint64_t &r_total, uint64_t &r_used) {
+	struct mallinfo mi = mallinfo();
+	r_total = fake_heap_end - fake_heap_start + p_arena.reserved_bytes;
+	r_used = mi.uordblks + p_arena.used_bytes;
+}
+
+OS_Switch::MemoryInfo OS_Switch::get_memory_info() const {
+	MemoryInfo info;
+	svcGetInfo(&info.physical_total, InfoType_TotalMemorySize, CUR_PROCESS_HANDLE, 0);
+	svcGetInfo(&info.physical_used, InfoType_UsedMemorySize, CUR_PROCESS_HANDLE, 0);
+
+	AllocatorSwitch::Stats arena = AllocatorSwitch::get_stats();
+	info.arena_reserved = arena.reserved_bytes;
+	info.arena_used = arena.used_bytes;
+	get_heap_usage(arena, info.heap_total, info.heap_used);
+	return info;
+}
+
+// The process' used memory includes the whole heap from the start, what's
+// allocated in it is what the game can run out of.
+uint64_t OS_Switch::get_static_memory_usage() const {
+	uint64_t total, used;
+	get_heap_usage(AllocatorSwitch::get_stats(), total, used);
+
+	uint64_t peak = memory_peak_usage.load(std::memory_order_relaxed);
+	while (used > peak && !memory_peak_usage.compare_exchange_weak(peak, used, std::memory_order_relaxed)) {
+	}
+	return used;
+}
+
+uint64_t OS_Switch::get_static_memory_peak_usage() const {
+	get_static_memory_usage();
+	return memory_peak_usage.load(std::memory_order_relaxed);
+}
+
+uint64_t OS_Switch::get_free_static_memory() const {
+	return get_free_heap_memory();
+}
+
+uint64_t OS_Switch::get_free_heap_memory() const {
+	uint64_t total, used;
+	get_heap_usage(AllocatorSwitch::get_stats(), total, used);
+	return total > used ? total - used : 0;
+}
+
+void OS_Switch::add_low_memory_callback(void (*p_callback)()) {
+	low_memory_callbacks.push_back(p_callback);
+}
+
+#define MEMORY_SAMPLE_INTERVAL_USEC 1000000
+
+// Peaks between queries would go unnoticed, so keep a coarse watch from the main loop.
+void OS_Switch::_sample_memory_usage() {
+	get_static_memory_usage();
+	if (low_memory_threshold != 0) {
+		_check_low_memory();
+	}
+	memory_next_sample_usec = get_ticks_usec() + MEMORY_SAMPLE_INTERVAL_USEC;
+}
+
+// Give caches and the game a chance to release memory before allocations start failing.
+void OS_Switch::_check_low_memory() {
+	uint64_t free_memory = get_free_heap_memory();
+
+	if (low_memory) {
+		// Re-arm once we have clearly recovered, so we don't fire every second at the edge.
+		if (free_memory > low_memory_threshold + low_memory_threshold / 4) {
+			low_memory = false;
+		}
+		return;
+	}
+
+	if (free_memory >= low_memory_threshold) {
+		return;
+	}
+	low_memory = true;
+
+	WARN_PRINT("Low memory: " + String::humanize_size(free_memory) + " of heap left, releasing caches.");
+	for (int i = 0; i < low_memory_callbacks.size(); i++) {
+		low_memory_callbacks[i]();
+	}
+	if (main_loop) {
+		main_loop->notification(MainLoop::NOTIFICATION_OS_MEMORY_WARNING);
+	}
 }
 
 bool OS_Switch::can_draw() const {
-	return true;
+	return focused;
 }
 
 void OS_Switch::set_cursor_shape(CursorShape p_shape) {}
@@ -399,9 +637,94 @@ void OS_Switch::key(uint32_t p_key, bool p_pressed) {
 	input->parse_input_event(ev);
 };
 
+void OS_Switch::_applet_hook(AppletHookType p_hook, void *p_param) {
+	OS_Switch *os = (OS_Switch *)p_param;
+
+	switch (p_hook) {
+		case AppletHookType_OnFocusState:
+		case AppletHookType_OnResume:
+			os->_update_focus_state();
+			break;
+		default:
+			break;
+	}
+}
+
+void OS_Switch::_update_focus_state() {
+	bool now_focused = appletGetFocusState() == AppletFocusState_InFocus;
+	if (now_focused == focused) {
+		return;
+	}
+	focused = now_focused;
+
+	if (!focused) {
+		focus_lost_usec = _get_raw_ticks_usec();
+		driver_audren.set_paused(true);
+		if (main_loop) {
+			main_loop->notification(MainLoop::NOTIFICATION_WM_FOCUS_OUT);
+		}
+	} else {
+		suspended_usec.fetch_add(_get_raw_ticks_usec() - focus_lost_usec, std::memory_order_relaxed);
+		// The user may have changed the time zone from the HOME menu.
+		time_zone_mutex.lock();
+		time_zone_expiry_usec = 0;
+		time_zone_mutex.unlock();
+		driver_audren.set_paused(false);
+		if (main_loop) {
+			main_loop->notification(MainLoop::NOTIFICATION_WM_FOCUS_IN);
+		}
+	}
+}
+
+#define POWER_SAVING_CHECK_INTERVAL_USEC 1000000
+// Battery readings jitter around a threshold, only leave a tier once clearly above it.
+#define POWER_SAVING_HYSTERESIS_PERCENT 5
+
+void OS_Switch::_update_power_saving() {
+	uint64_t now = get_ticks_usec();
+	if (now < power_saving_next_check_usec) {
+		return;
+	}
+	power_saving_next_check_usec = now + POWER_SAVING_CHECK_INTERVAL_USEC;
+
+	NintendoSwitch *ns = NintendoSwitch::get_singleton();
+	NintendoSwitch::PowerSavingTier current = ns->get_power_saving_tier();
+	NintendoSwitch::PowerSavingTier tier = NintendoSwitch::POWER_SAVING_NONE;
+
+	if (power_manager->get_power_state() == OS::POWERSTATE_ON_BATTERY) {
+		int percent = power_manager->get_power_percent_left();
+		int margin = POWER_SAVING_HYSTERESIS_PERCENT;
+		if (percent >= 0 && percent <= power_saving.critical_percent + (current == NintendoSwitch::POWER_SAVING_CRITICAL ? margin : 0)) {
+			tier = NintendoSwitch::POWER_SAVING_CRITICAL;
+		} else if (percent >= 0 && percent <= power_saving.low_percent + (current != NintendoSwitch::POWER_SAVING_NONE ? margin : 0)) {
+			tier = NintendoSwitch::POWER_SAVING_LOW;
+		}
+	}
+
+	if (tier == current) {
+		return;
+	}
+
+	if (current == NintendoSwitch::POWER_SAVING_NONE) {
+		power_saving_saved_target_fps = Engine::get_singleton()->get_target_fps();
+	}
+
+	if (tier == NintendoSwitch::POWER_SAVING_NONE) {
+		Engine::get_singleton()->set_target_fps(power_saving_saved_target_fps);
+	} else {
+		int fps = tier == NintendoSwitch::POWER_SAVING_CRITICAL ? power_saving.critical_target_fps : power_saving.low_target_fps;
+		if (power_saving_saved_target_fps > 0) {
+			fps = MIN(fps, power_saving_saved_target_fps);
+		}
+		Engine::get_singleton()->set_target_fps(fps);
+	}
+
+	ns->set_power_saving_tier(tier);
+}
+
 void OS_Switch::run() {
 	if (!main_loop) {
-		TRACE("No main loop?\n");
+		TRACE("No main loop?");
 		return;
 	}
 
@@ -417,6 +740,14 @@ void OS_Switch::run() {
 	hidInitializeTouchScreen();
 
 	while (appletMainLoop()) {
+		if (!focused) {
+			// HOME menu, sleep or an overlay applet has the screen: don't render,
+			// don't step the game, just keep pumping applet messages.
+			NintendoSwitch::get_singleton()->update();
+			svcSleepThread(16000000ll);
+			continue;
+		}
+
 		if (NintendoSwitch::get_singleton()->is_virtual_keyboard_open()) {
 			for (int i = 0; i < last_touch_count; i++) {
 				Ref<InputEventScreenTouch> st;
@@ -477,13 +808,40 @@ void OS_Switch::run() {
 
 		NintendoSwitch::get_singleton()->update();
 
-		if (Main::iteration())
+		if (power_saving.enabled) {
+			_update_power_saving();
+		}
+
+		if (get_ticks_usec() >= memory_next_sample_usec) {
+			_sample_memory_usage();
+		}
+
+#ifdef OPENGL_ENABLED
+		if (gl_context->is_context_lost()) {
+			_handle_context_lost();
+			break;
+		}
+#endif
+
+		reading_frame_ticks = true;
+		bool quit = Main::iteration();
+		reading_frame_ticks = false;
+		if (quit)
 			break;
 	}
 
 	main_loop->finish();
 }
 
+void OS_Switch::_handle_context_lost() {
+	// The rasterizers can't recreate their textures, buffers and shaders on a new
+	// context, so relaunch instead of rendering with dead handles. The game gets the
+	// usual quit request first to save its state.
+	ERR_PRINT("The GL context was lost, restarting.");
+	set_restart_on_exit(true, get_cmdline_args());
+	main_loop->notification(MainLoop::NOTIFICATION_WM_QUIT_REQUEST);
+}
+
 bool OS_Switch::has_touchscreen_ui_hint() const {
 	return true;
 }
@@ -508,39 +866,24 @@ void OS_Switch::hide_virtual_keyboard() {
 }
 
 OS::PowerState OS_Switch::get_power_state() {
-	if (!OS_Switch::psm_initialized) {
+	if (!power_manager) {
 		return OS::POWERSTATE_UNKNOWN;
 	}
-
-	bool enough_power;
-	psmIsEnoughPowerSupplied(&enough_power);
-
-	if (!enough_power) {
-		return OS::PowerState::POWERSTATE_ON_BATTERY;
-	}
-
-	int percentage = OS_Switch::get_power_percent_left();
-
-	if (percentage == 100) {
-		return OS::PowerState::POWERSTATE_CHARGED;
-	}
-
-	return OS::PowerState::POWERSTATE_CHARGING;
+	return power_manager->get_power_state();
 }
 
 int OS_Switch::get_power_seconds_left() {
-	WARN_PRINT("power_seconds_left is not implemented on this platform, defaulting to -1");
-	return -1;
+	if (!power_manager) {
+		return -1;
+	}
+	return power_manager->get_power_seconds_left();
 }
 
 int OS_Switch::get_power_percent_left() {
-	if (!OS_Switch::psm_initialized) {
+	if (!power_manager) {
 		return -1;
 	}
-
-	u32 voltage_percentage;
-	psmGetBatteryChargePercentage(&voltage_percentage);
-	return (int)voltage_percentage;
+	return power_manager->get_power_percent_left();
 }
 
 String OS_Switch::get_executable_path() const {
@@ -582,6 +925,10 @@ OS_Switch::OS_Switch() {
 	visual_server = nullptr;
 	input = nullptr;
 	gl_context = nullptr;
+	power_manager = nullptr;
+	suspended_usec.store(0);
+	memory_peak_usage.store(0);
+	ticks_to_usec_factor = ticks_switch_usec_factor(armGetSystemTickFreq());
 
 	AudioDriverManager::add_driver(&driver_audren);
 }
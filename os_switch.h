@@ -31,13 +31,16 @@
 #include "api/switch_singleton.h"
 #include "context_gl_switch_egl.h"
 #include "core/os/input.h"
+#include "core/os/mutex.h"
 #include "core/os/os.h"
 #include "drivers/audren/audio_driver_audren.h"
 #include "joypad_switch.h"
 #include "main/input_default.h"
+#include "power_switch.h"
 #include "servers/visual/visual_server_raster.h"
 
 #include <time.h>
+#include <atomic>
 
 class OS_Switch : public OS {
 	int video_driver_index;
@@ -46,13 +49,50 @@ class OS_Switch : public OS {
 	VisualServer *visual_server;
 	InputDefault *input;
 	ContextGLSwitchEGL *gl_context;
+	bool astc_supported = false; // the rasterizers don't know about ASTC, so it's checked here
 	JoypadSwitch *joypad;
 	AudioDriverAudren driver_audren;
 	String switch_execpath;
 
 	SwkbdInline inline_keyboard;
 
-	bool psm_initialized = false;
+	PowerSwitch *power_manager;
+
+	struct PowerSavingSettings {
+		bool enabled = false;
+		int low_percent = 30;
+		int critical_percent = 15;
+		int low_target_fps = 30;
+		int critical_target_fps = 20;
+	} power_saving;
+	int power_saving_saved_target_fps = 0;
+	uint64_t power_saving_next_check_usec = 0;
+
+	mutable std::atomic<uint64_t> memory_peak_usage;
+	uint64_t memory_next_sample_usec = 0;
+	uint64_t low_memory_threshold = 0;
+	bool low_memory = false;
+	Vector<void (*)()> low_memory_callbacks;
+
+	AppletHookCookie applet_hook_cookie;
+	bool focused = true;
+	uint64_t focus_lost_usec = 0;
+	// Time spent out of focus, left out of the main loop's frame delta so it
+	// doesn't try to catch up on the frames it skipped.
+	std::atomic<uint64_t> suspended_usec;
+
+	mutable Mutex time_zone_mutex;
+	mutable TimeZoneInfo time_zone_info;
+	mutable uint64_t time_zone_expiry_usec = 0;
+
+	static void _applet_hook(AppletHookType p_hook, void *p_param);
+	void _update_focus_state();
+	uint64_t _get_raw_ticks_usec() const;
+	void _update_power_saving();
+	void _sample_memory_usage();
+	void _check_low_memory();
+
+	void _handle_context_lost();
 
 protected:
 	virtual void initialize_core();
@@ -65,6 +105,25 @@ protected:
 	virtual void finalize_core();
 
 public:
+	struct MemoryInfo {
+		uint64_t physical_total; // memory the kernel lets this process use
+		uint64_t physical_used;
+		uint64_t heap_total; // heap handed to us by libnx
+		uint64_t heap_used; // by newlib and AllocatorSwitch together
+		uint64_t arena_reserved; // see AllocatorSwitch, 0 when disabled
+		uint64_t arena_used;
+	};
+
+	struct FrameTiming {
+		int swap_chain_depth; // 2 for double buffering, 3 for triple
+		int present_queue_depth; // frames swapped but not finished by the GPU
+		uint32_t cpu_frame_usec; // render thread time between two swaps
+		uint32_t present_wait_usec; // render thread time blocked in the swap
+		bool gpu_timing_supported;
+		uint32_t gpu_frame_usec; // a few frames old, see GPUTimerSwitch
+		uint32_t gpu_frame_average_usec;
+	};
+
 	virtual bool _check_internal_feature_support(const String &p_feature);
 
 	virtual void alert(const String &p_alert, const String &p_title = "ALERT!");
@@ -76,7 +135,6 @@ public:
 	virtual void set_video_mode(const VideoMode &p_video_mode, int p_screen);
 	virtual VideoMode get_video_mode(int p_screen) const;
 	virtual void get_fullscreen_mode_list(List<VideoMode> *p_list, int p_screen) const;
-	OS::RenderThreadMode get_render_thread_mode() const;
 
 	virtual int get_current_video_driver() const;
 	virtual Size2 get_window_size() const;
@@ -98,8 +156,18 @@ public:
 	virtual Date get_date(bool utc = false) const;
 	virtual Time get_time(bool utc = false) const;
 	virtual TimeZoneInfo get_time_zone_info() const;
+	void get_date_time(bool p_utc, Date &r_date, Time &r_time) const;
 	virtual void delay_usec(uint32_t p_usec) const;
 	virtual uint64_t get_ticks_usec() const;
+
+	MemoryInfo get_memory_info() const;
+	FrameTiming get_frame_timing() const;
+	uint64_t get_free_heap_memory() const;
+	// Called on the main thread when free heap drops below the configured threshold.
+	void add_low_memory_callback(void (*p_callback)());
+	virtual uint64_t get_static_memory_usage() const;
+	virtual uint64_t get_static_memory_peak_usage() const;
+	virtual uint64_t get_free_static_memory() const;
 	virtual bool can_draw() const;
 	virtual void set_cursor_shape(CursorShape p_shape);
 	virtual void set_custom_mouse_cursor(const RES &p_cursor, CursorShape p_shape, const Vector2 &p_hotspot);
@@ -116,9 +184,12 @@ public:
 	virtual int get_virtual_keyboard_height() const;
 
 	void run();
+	virtual void release_rendering_thread();
+	virtual void make_rendering_thread();
 	virtual void swap_buffers();
 
 	void key(uint32_t p_key, bool p_pressed);
+	bool is_focused() const { return focused; }
 
 	static OS_Switch *get_singleton();
 
@@ -0,0 +1,233 @@
+/**************************************************************************/
+/*  pack_source_switch.cpp                                                */
+/**************************************************************************/
+/*                         This file is part of:                          */
+/*                             GODOT ENGINE                               */
+/*                        https://godotengine.org                         */
+/**************************************************************************/
+/* Copyright (c) 2014-present Godot Engine contributors (see AUTHORS.md). */
+/* Copyright (c) 2007-2014 Juan Linietsky, Ariel Manzur.                  */
+/*                                                                        */
+/* Permission is hereby granted, free of charge, to any person obtaining  */
+/* a copy of this software and associated documentation files (the        */
+/* "Software"), to deal in the Software without restriction, including    */
+/* without limitation the rights to use, copy, modify, merge, publish,    */
+/* distribute, sublicense, and/or sell copies of the Software, and to     */
+/* permit persons to whom the Software is furnished to do so, subject to  */
+/* the following conditions:                                              */
+/*                                                                        */
+/* The above copyright notice and this permission notice shall be         */
+/* included in all copies or substantial portions of the Software.        */
+/*                                                                        */
+/* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,        */
+/* EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF     */
+/* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. */
+/* IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY   */
+/* CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,   */
+/* TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE      */
+/* SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.                 */
+/**************************************************************************/
+
+#include "pack_source_switch.h"
+
+#include "core/version.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+
+uint64_t PackSourceSwitch::read(uint64_t p_offset, uint8_t *p_dst, uint64_t p_length) {
+	MutexLock lock(mutex);
+	if (fd < 0 || lseek(fd, p_offset, SEEK_SET) < 0) {
+		return 0;
+	}
+
+	uint64_t done = 0;
+	while (done < p_length) {
+		ssize_t count = ::read(fd, p_dst + done, p_length - done);
+		if (count <= 0) {
+			break;
+		}
+		done += count;
+	}
+	return done;
+}
+
+bool PackSourceSwitch::try_open_pack(const String &p_path, bool p_replace_files, uint64_t p_offset) {
+	if (!p_path.begins_with("romfs:/") || fd >= 0) {
+		return false;
+	}
+
+	FileAccess *f = FileAccess::open(p_path, FileAccess::READ);
+	if (!f) {
+		return false;
+	}
+	f->seek(p_offset);
+
+	if (f->get_32() != PACK_HEADER_MAGIC) {
+		f->close();
+		memdelete(f);
+		return false;
+	}
+
+	uint32_t version = f->get_32();
+	uint32_t ver_major = f->get_32();
+	uint32_t ver_minor = f->get_32();
+	f->get_32(); // patch number, not used for validation.
+
+	if (version != PACK_FORMAT_VERSION || ver_major > VERSION_MAJOR || (ver_major == VERSION_MAJOR && ver_minor > VERSION_MINOR)) {
+		f->close();
+		memdelete(f);
+		ERR_FAIL_V_MSG(false, "Pack created with a newer version of the engine: " + itos(ver_major) + "." + itos(ver_minor) + ".");
+	}
+
+	for (int i = 0; i < 16; i++) {
+		// Reserved.
+		f->get_32();
+	}
+
+	// Only index the pack once it can actually be served, so a failed open
+	// leaves the entries of any previously loaded pack untouched.
+	fd = ::open(p_path.utf8().get_data(), O_RDONLY);
+	if (fd < 0) {
+		f->close();
+		memdelete(f);
+		return false;
+	}
+
+	int file_count = f->get_32();
+	for (int i = 0; i < file_count; i++) {
+		uint32_t sl = f->get_32();
+		CharString cs;
+		cs.resize(sl + 1);
+		f->get_buffer((uint8_t *)cs.ptrw(), sl);
+		cs.ptrw()[sl] = 0;
+
+		String path;
+		path.parse_utf8(cs.ptr());
+
+		uint64_t ofs = f->get_64();
+		uint64_t size = f->get_64();
+		uint8_t md5[16];
+		f->get_buffer(md5, 16);
+
+		PackedData::get_singleton()->add_path(p_path, path, ofs + p_offset, size, md5, this, p_replace_files);
+	}
+
+	f->close();
+	memdelete(f);
+
+	return true;
+}
+
+FileAccess *PackSourceSwitch::get_file(const String &p_path, PackedData::PackedFile *p_file) {
+	return memnew(FileAccessPackSwitch(this, *p_file));
+}
+
+PackSourceSwitch::~PackSourceSwitch() {
+	if (fd >= 0) {
+		::close(fd);
+	}
+}
+
+Error FileAccessPackSwitch::_open(const String &p_path, int p_mode_flags) {
+	ERR_FAIL_V(ERR_UNAVAILABLE);
+}
+
+void FileAccessPackSwitch::seek(uint64_t p_position) {
+	eof = p_position > pf.size;
+	pos = MIN(p_position, pf.size);
+}
+
+void FileAccessPackSwitch::seek_end(int64_t p_position) {
+	seek(pf.size + p_position);
+}
+
+bool FileAccessPackSwitch::_fill_window(uint64_t p_position) const {
+	if (p_position >= window_pos && p_position < window_pos + window_len) {
+		return true;
+	}
+
+	uint64_t length = MIN((uint64_t)PackSourceSwitch::READ_WINDOW_SIZE, pf.size - p_position);
+	window_pos = p_position;
+	window_len = source->read(pf.offset + p_position, window.ptrw(), length);
+	return window_len > 0;
+}
+
+uint8_t FileAccessPackSwitch::get_8() const {
+	if (pos >= pf.size) {
+		eof = true;
+		return 0;
+	}
+
+	if (!_fill_window(pos)) {
+		eof = true;
+		return 0;
+	}
+
+	return window[pos++ - window_pos];
+}
+
+uint64_t FileAccessPackSwitch::get_buffer(uint8_t *p_dst, uint64_t p_length) const {
+	ERR_FAIL_COND_V(!p_dst && p_length > 0, -1);
+
+	if (eof) {
+		return 0;
+	}
+
+	uint64_t to_read = p_length;
+	if (pos + to_read > pf.size) {
+		eof = true;
+		to_read = pf.size - pos;
+	}
+
+	uint64_t done = 0;
+	while (done < to_read) {
+		uint64_t left = to_read - done;
+		bool in_window = pos >= window_pos && pos < window_pos + window_len;
+
+		if (!in_window && left >= (uint64_t)PackSourceSwitch::READ_WINDOW_SIZE) {
+			// Large transfers go straight to the destination.
+			uint64_t count = source->read(pf.offset + pos, p_dst + done, left);
+			done += count;
+			pos += count;
+			if (count < left) {
+				eof = true;
+			}
+			break;
+		}
+
+		if (!_fill_window(pos)) {
+			eof = true;
+			break;
+		}
+
+		uint64_t count = MIN(left, window_pos + window_len - pos);
+		memcpy(p_dst + done, window.ptr() + (pos - window_pos), count);
+		done += count;
+		pos += count;
+	}
+	return done;
+}
+
+void FileAccessPackSwitch::flush() {
+	ERR_FAIL();
+}
+
+void FileAccessPackSwitch::store_8(uint8_t p_dest) {
+	ERR_FAIL();
+}
+
+void FileAccessPackSwitch::store_buffer(const uint8_t *p_src, uint64_t p_length) {
+	ERR_FAIL();
+}
+
+FileAccessPackSwitch::FileAccessPackSwitch(PackSourceSwitch *p_source, const PackedData::PackedFile &p_file) :
+		source(p_source),
+		pf(p_file) {
+	window.resize(MIN(pf.size, (uint64_t)PackSourceSwitch::READ_WINDOW_SIZE));
+
+	// .import, .remap, scripts and most resources fit, and are then read with one call.
+	if (pf.size <= PackSourceSwitch::SMALL_FILE_SIZE) {
+		_fill_window(0);
+	}
+}
@@ -0,0 +1,106 @@
+/**************************************************************************/
+/*  pack_source_switch.h                                                  */
+/**************************************************************************/
+/*                         This file is part of:                          */
+/*                             GODOT ENGINE                               */
+/*                        https://godotengine.org                         */
+/**************************************************************************/
+/* Copyright (c) 2014-present Godot Engine contributors (see AUTHORS.md). */
+/* Copyright (c) 2007-2014 Juan Linietsky, Ariel Manzur.                  */
+/*                                                                        */
+/* Permission is hereby granted, free of charge, to any person obtaining  */
+/* a copy of this software and associated documentation files (the        */
+/* "Software"), to deal in the Software without restriction, including    */
+/* without limitation the rights to use, copy, modify, merge, publish,    */
+/* distribute, sublicense, and/or sell copies of the Software, and to     */
+/* permit persons to whom the Software is furnished to do so, subject to  */
+/* the following conditions:                                              */
+/*                                                                        */
+/* The above copyright notice and this permission notice shall be         */
+/* included in all copies or substantial portions of the Software.        */
+/*                                                                        */
+/* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,        */
+/* EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF     */
+/* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. */
+/* IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY   */
+/* CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,   */
+/* TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE      */
+/* SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.                 */
+/**************************************************************************/
+
+#ifndef PACK_SOURCE_SWITCH_H
+#define PACK_SOURCE_SWITCH_H
+
+#include "core/io/file_access_pack.h"
+#include "core/os/mutex.h"
+
+// Serves a game.pck embedded in romfs (binary_format/embed_pck) from a single
+// shared handle, instead of reopening the pack through the romfs devoptab for
+// every resource. Small files are read whole when opened, so most reads never
+// touch the handle or its lock; larger files are read through a per-file
+// window of the same size.
+class PackSourceSwitch : public PackSource {
+	Mutex mutex;
+	int fd = -1;
+
+public:
+	enum {
+		SMALL_FILE_SIZE = 64 * 1024,
+		READ_WINDOW_SIZE = 64 * 1024,
+	};
+
+	// Thread safe, returns the number of bytes read.
+	uint64_t read(uint64_t p_offset, uint8_t *p_dst, uint64_t p_length);
+
+	virtual bool try_open_pack(const String &p_path, bool p_replace_files, uint64_t p_offset);
+	virtual FileAccess *get_file(const String &p_path, PackedData::PackedFile *p_file);
+
+	virtual ~PackSourceSwitch();
+};
+
+class FileAccessPackSwitch : public FileAccess {
+	PackSourceSwitch *source;
+	PackedData::PackedFile pf;
+
+	mutable uint64_t pos = 0;
+	mutable bool eof = false;
+
+	// Holds [window_pos, window_pos + window_len) of the file; the whole file
+	// for small files.
+	mutable Vector<uint8_t> window;
+	mutable uint64_t window_pos = 0;
+	mutable uint64_t window_len = 0;
+
+	bool _fill_window(uint64_t p_position) const;
+
+	virtual Error _open(const String &p_path, int p_mode_flags);
+	virtual uint64_t _get_modified_time(const String &p_file) { return 0; }
+	virtual uint32_t _get_unix_permissions(const String &p_file) { return 0; }
+	virtual Error _set_unix_permissions(const String &p_file, uint32_t p_permissions) { return FAILED; }
+
+public:
+	virtual void close() {}
+	virtual bool is_open() const { return true; }
+
+	virtual void seek(uint64_t p_position);
+	virtual void seek_end(int64_t p_position = 0);
+	virtual uint64_t get_position() const { return pos; }
+	virtual uint64_t get_len() const { return pf.size; }
+
+	virtual bool eof_reached() const { return eof; }
+
+	virtual uint8_t get_8() const;
+	virtual uint64_t get_buffer(uint8_t *p_dst, uint64_t p_length) const;
+
+	virtual Error get_error() const { return eof ? ERR_FILE_EOF : OK; }
+
+	virtual void flush();
+	virtual void store_8(uint8_t p_dest);
+	virtual void store_buffer(const uint8_t *p_src, uint64_t p_length);
+
+	virtual bool file_exists(const String &p_name) { return false; }
+
+	FileAccessPackSwitch(PackSourceSwitch *p_source, const PackedData::PackedFile &p_file);
+};
+
+#endif // PACK_SOURCE_SWITCH_H
@@ -0,0 +1,145 @@
+/**************************************************************************/
+/*  power_switch.cpp                                                      */
+/**************************************************************************/
+/*                         This file is part of:                          */
+/*                             GODOT ENGINE                               */
+/*                        https://godotengine.org                         */
+/**************************************************************************/
+/* Copyright (c) 2014-present Godot Engine contributors (see AUTHORS.md). */
+/* Copyright (c) 2007-2014 Juan Linietsky, Ariel Manzur.                  */
+/*                                                                        */
+/* Permission is hereby granted, free of charge, to any person obtaining  */
+/* a copy of this software and associated documentation files (the        */
+/* "Software"), to deal in the Software without restriction, including    */
+/* without limitation the rights to use, copy, modify, merge, publish,    */
+/* distribute, sublicense, and/or sell copies of the Software, and to     */
+/* permit persons to whom the Software is furnished to do so, subject to  */
+/* the following conditions:                                              */
+/*                                                                        */
+/* The above copyright notice and this permission notice shall be         */
+/* included in all copies or substantial portions of the Software.        */
+/*                                                                        */
+/* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,        */
+/* EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF     */
+/* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. */
+/* IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY   */
+/* CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,   */
+/* TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE      */
+/* SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.                 */
+/**************************************************************************/
+
+#include "power_switch.h"
+
+// psm only signals on charger, power supply and voltage state changes, so the
+// charge level is also resampled periodically to keep the discharge model fed.
+#define STATE_CHANGE_WAIT_NS 500000000ull
+#define RESAMPLE_INTERVAL_NS 30000000000ull
+#define DISCHARGE_RATE_SMOOTHING 0.2
+
+void PowerSwitch::update_state() {
+	bool enough_power = false;
+	u32 percentage = 0;
+	double raw_percentage = 0.0;
+	psmIsEnoughPowerSupplied(&enough_power);
+	psmGetBatteryChargePercentage(&percentage);
+	if (R_FAILED(psmGetRawBatteryChargePercentage(&raw_percentage))) {
+		raw_percentage = percentage;
+	}
+	uint64_t now = armTicksToNs(armGetSystemTick());
+
+	MutexLock lock(mutex);
+
+	percent_left = (int)percentage;
+
+	if (enough_power) {
+		power_state = percentage == 100 ? OS::POWERSTATE_CHARGED : OS::POWERSTATE_CHARGING;
+		discharge_rate = 0.0;
+		last_sample_ns = 0;
+		seconds_left = -1;
+		return;
+	}
+
+	power_state = OS::POWERSTATE_ON_BATTERY;
+
+	if (last_sample_ns != 0 && raw_percentage < last_sample_percent) {
+		double rate = (last_sample_percent - raw_percentage) / ((now - last_sample_ns) / 1000000000.0);
+		if (discharge_rate == 0.0) {
+			discharge_rate = rate;
+		} else {
+			discharge_rate += (rate - discharge_rate) * DISCHARGE_RATE_SMOOTHING;
+		}
+	}
+
+	// Only move the reference point once the level actually dropped, otherwise
+	// the coarse readings would produce long zero-rate intervals.
+	if (last_sample_ns == 0 || raw_percentage < last_sample_percent) {
+		last_sample_percent = raw_percentage;
+		last_sample_ns = now;
+	}
+
+	seconds_left = discharge_rate > 0.0 ? (int)(raw_percentage / discharge_rate) : -1;
+}
+
+void PowerSwitch::thread_func(void *p_udata) {
+	PowerSwitch *power = (PowerSwitch *)p_udata;
+	uint64_t next_resample = armTicksToNs(armGetSystemTick()) + RESAMPLE_INTERVAL_NS;
+
+	while (!power->exit_thread) {
+		bool changed = R_SUCCEEDED(psmWaitStateChangeEvent(&power->session, STATE_CHANGE_WAIT_NS));
+		uint64_t now = armTicksToNs(armGetSystemTick());
+
+		if (changed || now >= next_resample) {
+			power->update_state();
+			next_resample = now + RESAMPLE_INTERVAL_NS;
+		}
+	}
+}
+
+OS::PowerState PowerSwitch::get_power_state() {
+	MutexLock lock(mutex);
+	return power_state;
+}
+
+int PowerSwitch::get_power_seconds_left() {
+	MutexLock lock(mutex);
+	return seconds_left;
+}
+
+int PowerSwitch::get_power_percent_left() {
+	MutexLock lock(mutex);
+	return percent_left;
+}
+
+PowerSwitch::PowerSwitch() :
+		initialized(false),
+		session_bound(false),
+		exit_thread(false),
+		power_state(OS::POWERSTATE_UNKNOWN),
+		percent_left(-1),
+		seconds_left(-1),
+		last_sample_percent(0.0),
+		last_sample_ns(0),
+		discharge_rate(0.0) {
+	if (R_FAILED(psmInitialize())) {
+		return;
+	}
+	initialized = true;
+
+	update_state();
+
+	if (R_SUCCEEDED(psmBindStateChangeEvent(&session, true, true, true))) {
+		session_bound = true;
+		thread.start(PowerSwitch::thread_func, this);
+	}
+}
+
+PowerSwitch::~PowerSwitch() {
+	if (session_bound) {
+		exit_thread = true;
+		thread.wait_to_finish();
+		psmUnbindStateChangeEvent(&session);
+	}
+	if (initialized) {
+		psmExit();
+	}
+}
@@ -0,0 +1,70 @@
+/**************************************************************************/
+/*  power_switch.h                                                        */
+/**************************************************************************/
+/*                         This file is part of:                          */
+/*                             GODOT ENGINE                               */
+/*                        https://godotengine.org                         */
+/**************************************************************************/
+/* Copyright (c) 2014-present Godot Engine contributors (see AUTHORS.md). */
+/* Copyright (c) 2007-2014 Juan Linietsky, Ariel Manzur.                  */
+/*                                                                        */
+/* Permission is hereby granted, free of charge, to any person obtaining  */
+/* a copy of this software and associated documentation files (the        */
+/* "Software"), to deal in the Software without restriction, including    */
+/* without limitation the rights to use, copy, modify, merge, publish,    */
+/* distribute, sublicense, and/or sell copies of the Software, and to     */
+/* permit persons to whom the Software is furnished to do so, subject to  */
+/* the following conditions:                                              */
+/*                                                                        */
+/* The above copyright notice and this permission notice shall be         */
+/* included in all copies or substantial portions of the Software.        */
+/*                                                                        */
+/* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,        */
+/* EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF     */
+/* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. */
+/* IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY   */
+/* CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,   */
+/* TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE      */
+/* SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.                 */
+/**************************************************************************/
+
+#ifndef POWER_SWITCH_H
+#define POWER_SWITCH_H
+
+#include "core/os/mutex.h"
+#include "core/os/os.h"
+#include "core/os/thread.h"
+#include "switch_wrapper.h"
+
+// Caches the psm battery state so callers don't pay two IPC round-trips per
+// query. A background thread refreshes it when psm signals a state change and
+// feeds a rolling discharge-rate estimate for get_power_seconds_left().
+class PowerSwitch {
+	Thread thread;
+	Mutex mutex;
+	PsmSession session;
+	bool initialized;
+	bool session_bound;
+	volatile bool exit_thread;
+
+	OS::PowerState power_state;
+	int percent_left;
+	int seconds_left;
+
+	double last_sample_percent;
+	uint64_t last_sample_ns;
+	double discharge_rate; // percent per second, 0 while unknown
+
+	void update_state();
+	static void thread_func(void *p_udata);
+
+public:
+	OS::PowerState get_power_state();
+	int get_power_seconds_left();
+	int get_power_percent_left();
+
+	PowerSwitch();
+	~PowerSwitch();
+};
+
+#endif // POWER_SWITCH_H
@@ -0,0 +1,144 @@
+/**************************************************************************/
+/*  shader_cache_entry_switch.h                                           */
+/**************************************************************************/
+/*                         This file is part of:                          */
+/*                             GODOT ENGINE                               */
+/*                        https://godotengine.org                         */
+/**************************************************************************/
+/* Copyright (c) 2014-present Godot Engine contributors (see AUTHORS.md). */
+/* Copyright (c) 2007-2014 Juan Linietsky, Ariel Manzur.                  */
+/*                                                                        */
+/* Permission is hereby granted, free of charge, to any person obtaining  */
+/* a copy of this software and associated documentation files (the        */
+/* "Software"), to deal in the Software without restriction, including    */
+/* without limitation the rights to use, copy, modify, merge, publish,    */
+/* distribute, sublicense, and/or sell copies of the Software, and to     */
+/* permit persons to whom the Software is furnished to do so, subject to  */
+/* the following conditions:                                              */
+/*                                                                        */
+/* The above copyright notice and this permission notice shall be         */
+/* included in all copies or substantial portions of the Software.        */
+/*                                                                        */
+/* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,        */
+/* EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF     */
+/* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. */
+/* IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY   */
+/* CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,   */
+/* TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE      */
+/* SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.                 */
+/**************************************************************************/
+
+#ifndef SHADER_CACHE_ENTRY_SWITCH_H
+#define SHADER_CACHE_ENTRY_SWITCH_H
+
+#include <stdint.h>
+#include <string.h>
+
+// On-disk layout of a program binary cache entry, and the checks done on it
+// before a binary reaches the driver. Kept free of engine and GL headers so it
+// can be built on the host, see tests/test_shader_cache_switch.cpp.
+//
+// The GL side is a template parameter providing:
+//   int32_t binary_length(uint32_t program);
+//   int32_t get_binary(uint32_t program, int32_t size, uint32_t *format, uint8_t *dst); // bytes written
+//   void program_binary(uint32_t program, uint32_t format, const uint8_t *src, int32_t length);
+//   bool link_status(uint32_t program);
+
+#define SHADER_CACHE_MAGIC 0x42505347 // "GSPB"
+#define SHADER_CACHE_VERSION 1
+
+struct ShaderCacheEntryHeader {
+	uint32_t magic;
+	uint32_t version;
+	uint8_t driver_hash[16];
+	uint32_t format;
+	uint32_t length;
+	uint32_t checksum;
+};
+
+// Same as the engine's hash_djb2_buffer.
+static inline uint32_t shader_cache_checksum(const uint8_t *p_data, uint32_t p_length) {
+	uint32_t hash = 5381;
+	for (uint32_t i = 0; i < p_length; i++) {
+		hash = ((hash << 5) + hash) + p_data[i];
+	}
+	return hash;
+}
+
+// False if the entry was written by another driver or cache version.
+static inline bool shader_cache_check_header(const ShaderCacheEntryHeader &p_header, const uint8_t *p_driver_hash) {
+	return p_header.magic == SHADER_CACHE_MAGIC && p_header.version == SHADER_CACHE_VERSION && memcmp(p_header.driver_hash, p_driver_hash, sizeof(p_header.driver_hash)) == 0;
+}
+
+// Returns the payload of an entry of p_size bytes, or nullptr if it is truncated,
+// corrupt, or was written by another driver or cache version.
+static inline const uint8_t *shader_cache_parse_entry(const uint8_t *p_entry, uint64_t p_size, const uint8_t *p_driver_hash, uint32_t &r_format, uint32_t &r_length) {
+	if (!p_entry || p_size < sizeof(ShaderCacheEntryHeader)) {
+		return nullptr;
+	}
+
+	ShaderCacheEntryHeader header;
+	memcpy(&header, p_entry, sizeof(header));
+	if (!shader_cache_check_header(header, p_driver_hash)) {
+		return nullptr;
+	}
+
+	const uint8_t *payload = p_entry + sizeof(header);
+	if (header.length == 0 || header.length != p_size - sizeof(header) || shader_cache_checksum(payload, header.length) != header.checksum) {
+		return nullptr;
+	}
+
+	r_format = header.format;
+	r_length = header.length;
+	return payload;
+}
+
+// Loads a parsed entry into p_program. False if the entry is invalid or the
+// driver rejected the binary, the caller then links from source and drops the entry.
+template <class T>
+bool shader_cache_load(T &p_gl, uint32_t p_program, const uint8_t *p_entry, uint64_t p_size, const uint8_t *p_driver_hash) {
+	uint32_t format;
+	uint32_t length;
+	const uint8_t *payload = shader_cache_parse_entry(p_entry, p_size, p_driver_hash, format, length);
+	if (!payload) {
+		return false;
+	}
+
+	p_gl.program_binary(p_program, format, payload, length);
+	return p_gl.link_status(p_program);
+}
+
+// Bytes needed to store p_program, 0 if the driver can't provide a binary.
+template <class T>
+uint64_t shader_cache_entry_size(T &p_gl, uint32_t p_program) {
+	int32_t length = p_gl.binary_length(p_program);
+	return length > 0 ? sizeof(ShaderCacheEntryHeader) + length : 0;
+}
+
+// Writes p_program as an entry into p_dst, which holds shader_cache_entry_size()
+// bytes. Returns the entry size, the binary can be shorter than announced.
+template <class T>
+uint64_t shader_cache_store(T &p_gl, uint32_t p_program, const uint8_t *p_driver_hash, uint8_t *p_dst, uint64_t p_capacity) {
+	if (p_capacity <= sizeof(ShaderCacheEntryHeader)) {
+		return 0;
+	}
+
+	uint8_t *payload = p_dst + sizeof(ShaderCacheEntryHeader);
+	uint32_t format = 0;
+	int32_t written = p_gl.get_binary(p_program, (int32_t)(p_capacity - sizeof(ShaderCacheEntryHeader)), &format, payload);
+	if (written <= 0 || (uint64_t)written > p_capacity - sizeof(ShaderCacheEntryHeader)) {
+		return 0;
+	}
+
+	ShaderCacheEntryHeader header;
+	header.magic = SHADER_CACHE_MAGIC;
+	header.version = SHADER_CACHE_VERSION;
+	memcpy(header.driver_hash, p_driver_hash, sizeof(header.driver_hash));
+	header.format = format;
+	header.length = written;
+	header.checksum = shader_cache_checksum(payload, written);
+	memcpy(p_dst, &header, sizeof(header));
+	return sizeof(header) + written;
+}
+
+#endif // SHADER_CACHE_ENTRY_SWITCH_H
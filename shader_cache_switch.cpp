@@ -0,0 +1,908 @@
+/**************************************************************************/
+/*  shader_cache_switch.cpp                                               */
+/**************************************************************************/
+/*                         This file is part of:                          */
+/*                             GODOT ENGINE                               */
+/*                        https://godotengine.org                         */
+/**************************************************************************/
+/* Copyright (c) 2014-present Godot Engine contributors (see AUTHORS.md). */
+/* Copyright (c) 2007-2014 Juan Linietsky, Ariel Manzur.                  */
+/*                                                                        */
+/* Permission is hereby granted, free of charge, to any person obtaining  */
+/* a copy of this software and associated documentation files (the        */
+/* "Software"), to deal in the Software without restriction, including    */
+/* without limitation the rights to use, copy, modify, merge, publish,    */
+/* distribute, sublicense, and/or sell copies of the Software, and to     */
+/* permit persons to whom the Software is furnished to do so, subject to  */
+/* the following conditions:                                              */
+/*                                                                        */
+/* The above copyright notice and this permission notice shall be         */
+/* included in all copies or substantial portions of the Software.        */
+/*                                                                        */
+/* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,        */
+/* EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF     */
+/* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. */
+/* IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY   */
+/* CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,   */
+/* TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE      */
+/* SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.                 */
+/**************************************************************************/
+
+#include "shader_cache_switch.h"
+
+#include "context_gl_switch_egl.h"
+#include "core/hash_map.h"
+#include "core/io/compression.h"
+#include "core/io/marshalls.h"
+#include "core/math/crypto_core.h"
+#include "core/os/dir_access.h"
+#include "core/os/file_access.h"
+#include "core/os/mutex.h"
+#include "core/os/os.h"
+#include "core/os/semaphore.h"
+#include "core/os/thread.h"
+#include "core/print_string.h"
+#include "core/project_settings.h"
+#include "core/set.h"
+#include "shader_cache_entry_switch.h"
+#include "switch_wrapper.h"
+
+#include <EGL/egl.h>
+#include <GLES3/gl3.h>
+#include <string.h>
+#include <atomic>
+
+#define LIST_MAGIC 0x4C505347 // "GSPL"
+#define PRELOAD_BUDGET (16 * 1024 * 1024)
+#define MAX_LIST_RECORD (4 * 1024 * 1024)
+
+extern "C" {
+void __real_glShaderSource(GLuint p_shader, GLsizei p_count, const GLchar *const *p_string, const GLint *p_length);
+void __real_glAttachShader(GLuint p_program, GLuint p_shader);
+void __real_glBindAttribLocation(GLuint p_program, GLuint p_index, const GLchar *p_name);
+void __real_glTransformFeedbackVaryings(GLuint p_program, GLsizei p_count, const GLchar *const *p_varyings, GLenum p_buffer_mode);
+void __real_glLinkProgram(GLuint p_program);
+void __real_glDeleteShader(GLuint p_shader);
+void __real_glDeleteProgram(GLuint p_program);
+
+void __wrap_glShaderSource(GLuint p_shader, GLsizei p_count, const GLchar *const *p_string, const GLint *p_length);
+void __wrap_glAttachShader(GLuint p_program, GLuint p_shader);
+void __wrap_glBindAttribLocation(GLuint p_program, GLuint p_index, const GLchar *p_name);
+void __wrap_glTransformFeedbackVaryings(GLuint p_program, GLsizei p_count, const GLchar *const *p_varyings, GLenum p_buffer_mode);
+void __wrap_glLinkProgram(GLuint p_program);
+void __wrap_glDeleteShader(GLuint p_shader);
+void __wrap_glDeleteProgram(GLuint p_program);
+}
+
+// glGetProgramBinary/glProgramBinary and their OES counterparts share a signature.
+typedef void (*GetProgramBinaryFunc)(GLuint p_program, GLsizei p_buffer_size, GLsizei *r_length, GLenum *r_format, void *r_binary);
+typedef void (*ProgramBinaryFunc)(GLuint p_program, GLenum p_format, const void *p_binary, GLsizei p_length);
+
+struct ShaderState {
+	GLint type = 0;
+	CharString source;
+};
+
+struct ProgramState {
+	struct Attribute {
+		GLuint index;
+		CharString name;
+	};
+
+	Vector<GLuint> shaders;
+	Vector<Attribute> attributes;
+	Vector<CharString> varyings;
+	GLenum buffer_mode = GL_NONE;
+};
+
+// Everything that goes into a program, independent of GL object names.
+struct ProgramSource {
+	struct Shader {
+		GLint type;
+		CharString source;
+	};
+
+	Vector<Shader> shaders;
+	Vector<ProgramState::Attribute> attributes;
+	Vector<CharString> varyings;
+	GLenum buffer_mode = GL_NONE;
+};
+
+static std::atomic<bool> enabled(false);
+static bool gles3 = false;
+static GetProgramBinaryFunc gl_get_program_binary = nullptr;
+static ProgramBinaryFunc gl_program_binary = nullptr;
+static uint8_t driver_hash[16];
+static String cache_dir;
+
+static Mutex mutex;
+static HashMap<GLuint, ShaderState> shaders;
+static HashMap<GLuint, ProgramState> programs;
+static HashMap<String, Vector<uint8_t> > preloaded; // whole entries, header included
+static int preloaded_bytes = 0;
+static Set<String> claimed_keys; // entries being written
+
+// Precompile list written during this run, read back by the next one.
+static Mutex list_mutex;
+static FileAccess *list_file = nullptr;
+static Set<String> listed_keys;
+
+// Entries built on the render thread, written by the worker. Their keys stay
+// claimed until then.
+struct PendingWrite {
+	String key;
+	Vector<uint8_t> entry;
+};
+static Vector<PendingWrite> pending_writes;
+
+static Thread worker_thread;
+static Semaphore worker_semaphore;
+static std::atomic<bool> worker_exit(false);
+static ContextGLSwitchEGL *gl_context = nullptr;
+
+static std::atomic<uint32_t> hits(0);
+static std::atomic<uint32_t> misses(0);
+static std::atomic<uint32_t> stale(0);
+static std::atomic<uint32_t> stores(0);
+static std::atomic<uint32_t> precompiled(0);
+
+// Must be called with the mutex held. Fails if a shader's source wasn't captured.
+static bool _gather_source(const ProgramState &p_program, ProgramSource &r_source) {
+	for (int i = 0; i < p_program.shaders.size(); i++) {
+		const ShaderState *state = shaders.getptr(p_program.shaders[i]);
+		if (!state) {
+			return false;
+		}
+		ProgramSource::Shader shader;
+		shader.type = state->type;
+		shader.source = state->source;
+		r_source.shaders.push_back(shader);
+	}
+	r_source.attributes = p_program.attributes;
+	r_source.varyings = p_program.varyings;
+	r_source.buffer_mode = p_program.buffer_mode;
+	return true;
+}
+
+static void _update_string(CryptoCore::MD5Context &p_ctx, const CharString &p_string) {
+	uint32_t length = p_string.length();
+	p_ctx.update((const uint8_t *)&length, sizeof(length));
+	p_ctx.update((const uint8_t *)p_string.get_data(), length);
+}
+
+static String _compute_key(const ProgramSource &p_source) {
+	CryptoCore::MD5Context ctx;
+	ctx.start();
+	ctx.update(driver_hash, sizeof(driver_hash));
+
+	for (int i = 0; i < p_source.shaders.size(); i++) {
+		ctx.update((const uint8_t *)&p_source.shaders[i].type, sizeof(GLint));
+		_update_string(ctx, p_source.shaders[i].source);
+	}
+	for (int i = 0; i < p_source.attributes.size(); i++) {
+		ctx.update((const uint8_t *)&p_source.attributes[i].index, sizeof(GLuint));
+		_update_string(ctx, p_source.attributes[i].name);
+	}
+	for (int i = 0; i < p_source.varyings.size(); i++) {
+		_update_string(ctx, p_source.varyings[i]);
+	}
+	ctx.update((const uint8_t *)&p_source.buffer_mode, sizeof(GLenum));
+
+	uint8_t key[16];
+	ctx.finish(key);
+	return String::hex_encode_buffer(key, sizeof(key));
+}
+
+static String _get_entry_path(const String &p_key) {
+	return cache_dir.plus_file(p_key + ".bin");
+}
+
+static void _remove_entry(const String &p_path) {
+	DirAccessRef da = DirAccess::create(DirAccess::ACCESS_FILESYSTEM);
+	da->remove(p_path);
+	stale.fetch_add(1, std::memory_order_relaxed);
+}
+
+// GL side of shader_cache_entry_switch.h.
+struct CacheGL {
+	int32_t binary_length(uint32_t p_program) {
+		GLint length = 0;
+		glGetProgramiv(p_program, GL_PROGRAM_BINARY_LENGTH, &length);
+		return length;
+	}
+
+	int32_t get_binary(uint32_t p_program, int32_t p_size, uint32_t *r_format, uint8_t *r_dst) {
+		GLsizei written = 0;
+		GLenum format = 0;
+		gl_get_program_binary(p_program, p_size, &written, &format, r_dst);
+		*r_format = format;
+		return written;
+	}
+
+	void program_binary(uint32_t p_program, uint32_t p_format, const uint8_t *p_src, int32_t p_length) {
+		gl_program_binary(p_program, p_format, p_src, p_length);
+	}
+
+	bool link_status(uint32_t p_program) {
+		GLint status = GL_FALSE;
+		glGetProgramiv(p_program, GL_LINK_STATUS, &status);
+		return status == GL_TRUE;
+	}
+};
+
+// Returns false if the entry is missing. A corrupt or stale entry is removed.
+static bool _read_entry(const String &p_path, Vector<uint8_t> &r_entry) {
+	FileAccess *f = FileAccess::open(p_path, FileAccess::READ);
+	if (!f) {
+		return false;
+	}
+
+	uint64_t size = f->get_len();
+	r_entry.resize(size);
+	bool read = f->get_buffer(r_entry.ptrw(), size) == size;
+	f->close();
+	memdelete(f);
+
+	uint32_t format;
+	uint32_t length;
+	if (!read || !shader_cache_parse_entry(r_entry.ptr(), r_entry.size(), driver_hash, format, length)) {
+		r_entry.clear();
+		_remove_entry(p_path);
+		return false;
+	}
+	return true;
+}
+
+// The worker and the render thread can build the same program at once, only
+// the one holding the key writes its entry.
+static bool _claim_key(const String &p_key) {
+	MutexLock lock(mutex);
+	if (claimed_keys.has(p_key)) {
+		return false;
+	}
+	claimed_keys.insert(p_key);
+	return true;
+}
+
+static void _release_key(const String &p_key) {
+	MutexLock lock(mutex);
+	claimed_keys.erase(p_key);
+}
+
+// The key of p_path has to be claimed.
+static void _write_entry(const String &p_path, const Vector<uint8_t> &p_entry) {
+	// Write aside and rename, so an interrupted write never leaves a valid-looking entry.
+	String tmp_path = p_path + ".tmp";
+	FileAccess *f = FileAccess::open(tmp_path, FileAccess::WRITE);
+	if (!f) {
+		return;
+	}
+	f->store_buffer(p_entry.ptr(), p_entry.size());
+	bool ok = f->get_error() == OK;
+	f->close();
+	memdelete(f);
+
+	DirAccessRef da = DirAccess::create(DirAccess::ACCESS_FILESYSTEM);
+	if (ok && da->rename(tmp_path, p_path) == OK) {
+		stores.fetch_add(1, std::memory_order_relaxed);
+	} else {
+		da->remove(tmp_path);
+	}
+}
+
+static bool _get_entry(GLuint p_program, Vector<uint8_t> &r_entry) {
+	CacheGL gl;
+	r_entry.resize(shader_cache_entry_size(gl, p_program));
+	if (r_entry.empty()) {
+		return false;
+	}
+	r_entry.resize(shader_cache_store(gl, p_program, driver_hash, r_entry.ptrw(), r_entry.size()));
+	return !r_entry.empty();
+}
+
+static void _queue_write(const String &p_key, const Vector<uint8_t> &p_entry) {
+	PendingWrite write;
+	write.key = p_key;
+	write.entry = p_entry;
+	{
+		MutexLock lock(mutex);
+		pending_writes.push_back(write);
+	}
+	worker_semaphore.post();
+}
+
+// Runs on the worker.
+static void _flush_writes() {
+	while (true) {
+		PendingWrite write;
+		{
+			MutexLock lock(mutex);
+			if (pending_writes.empty()) {
+				return;
+			}
+			write = pending_writes[0];
+			pending_writes.remove(0);
+		}
+		_write_entry(_get_entry_path(write.key), write.entry);
+		_release_key(write.key);
+	}
+}
+
+// Entries are validated when they are read, this only clears out the ones that
+// will never be looked up again (another driver version, interrupted writes).
+static void _remove_stale_entries() {
+	DirAccessRef da = DirAccess::open(cache_dir);
+	if (!da) {
+		return;
+	}
+
+	Vector<String> to_remove;
+	da->list_dir_begin();
+	for (String name = da->get_next(); name != ""; name = da->get_next()) {
+		if (worker_exit.load(std::memory_order_acquire)) {
+			break;
+		}
+		if (da->current_is_dir()) {
+			continue;
+		}
+
+		String path = cache_dir.plus_file(name);
+		if (name.ends_with(".bin.tmp")) {
+			// Left behind by an interrupted write, unless one is in progress.
+			String key = name.trim_suffix(".bin.tmp");
+			if (_claim_key(key)) {
+				da->remove(path);
+				_release_key(key);
+				stale.fetch_add(1, std::memory_order_relaxed);
+			}
+			continue;
+		}
+		if (!name.ends_with(".bin")) {
+			continue;
+		}
+
+		FileAccess *f = FileAccess::open(path, FileAccess::READ);
+		if (!f) {
+			continue;
+		}
+		ShaderCacheEntryHeader header;
+		if (f->get_buffer((uint8_t *)&header, sizeof(header)) != sizeof(header) || !shader_cache_check_header(header, driver_hash)) {
+			to_remove.push_back(path);
+		}
+		f->close();
+		memdelete(f);
+	}
+	da->list_dir_end();
+
+	for (int i = 0; i < to_remove.size(); i++) {
+		da->remove(to_remove[i]);
+	}
+	stale.fetch_add(to_remove.size(), std::memory_order_relaxed);
+}
+
+/* Precompile list */
+
+static void _put_u32(Vector<uint8_t> &r_buffer, uint32_t p_value) {
+	int ofs = r_buffer.size();
+	r_buffer.resize(ofs + 4);
+	encode_uint32(p_value, r_buffer.ptrw() + ofs);
+}
+
+static void _put_string(Vector<uint8_t> &r_buffer, const CharString &p_string) {
+	_put_u32(r_buffer, p_string.length());
+	int ofs = r_buffer.size();
+	r_buffer.resize(ofs + p_string.length());
+	memcpy(r_buffer.ptrw() + ofs, p_string.get_data(), p_string.length());
+}
+
+static bool _get_u32(const Vector<uint8_t> &p_buffer, int &r_ofs, uint32_t &r_value) {
+	if (r_ofs + 4 > p_buffer.size()) {
+		return false;
+	}
+	r_value = decode_uint32(p_buffer.ptr() + r_ofs);
+	r_ofs += 4;
+	return true;
+}
+
+static bool _get_string(const Vector<uint8_t> &p_buffer, int &r_ofs, CharString &r_string) {
+	uint32_t length;
+	if (!_get_u32(p_buffer, r_ofs, length) || length > (uint32_t)(p_buffer.size() - r_ofs)) {
+		return false;
+	}
+	r_string.resize(length + 1);
+	memcpy(r_string.ptrw(), p_buffer.ptr() + r_ofs, length);
+	r_string.ptrw()[length] = 0;
+	r_ofs += length;
+	return true;
+}
+
+static Vector<uint8_t> _encode_source(const ProgramSource &p_source) {
+	Vector<uint8_t> buffer;
+	_put_u32(buffer, p_source.shaders.size());
+	for (int i = 0; i < p_source.shaders.size(); i++) {
+		_put_u32(buffer, p_source.shaders[i].type);
+		_put_string(buffer, p_source.shaders[i].source);
+	}
+	_put_u32(buffer, p_source.attributes.size());
+	for (int i = 0; i < p_source.attributes.size(); i++) {
+		_put_u32(buffer, p_source.attributes[i].index);
+		_put_string(buffer, p_source.attributes[i].name);
+	}
+	_put_u32(buffer, p_source.varyings.size());
+	for (int i = 0; i < p_source.varyings.size(); i++) {
+		_put_string(buffer, p_source.varyings[i]);
+	}
+	_put_u32(buffer, p_source.buffer_mode);
+	return buffer;
+}
+
+static bool _decode_source(const Vector<uint8_t> &p_buffer, ProgramSource &r_source) {
+	int ofs = 0;
+	uint32_t count;
+
+	if (!_get_u32(p_buffer, ofs, count)) {
+		return false;
+	}
+	for (uint32_t i = 0; i < count; i++) {
+		ProgramSource::Shader shader;
+		uint32_t type;
+		if (!_get_u32(p_buffer, ofs, type) || !_get_string(p_buffer, ofs, shader.source)) {
+			return false;
+		}
+		shader.type = type;
+		r_source.shaders.push_back(shader);
+	}
+
+	if (!_get_u32(p_buffer, ofs, count)) {
+		return false;
+	}
+	for (uint32_t i = 0; i < count; i++) {
+		ProgramState::Attribute attribute;
+		if (!_get_u32(p_buffer, ofs, attribute.index) || !_get_string(p_buffer, ofs, attribute.name)) {
+			return false;
+		}
+		r_source.attributes.push_back(attribute);
+	}
+
+	if (!_get_u32(p_buffer, ofs, count)) {
+		return false;
+	}
+	for (uint32_t i = 0; i < count; i++) {
+		CharString varying;
+		if (!_get_string(p_buffer, ofs, varying)) {
+			return false;
+		}
+		r_source.varyings.push_back(varying);
+	}
+
+	uint32_t buffer_mode;
+	if (!_get_u32(p_buffer, ofs, buffer_mode)) {
+		return false;
+	}
+	r_source.buffer_mode = buffer_mode;
+	return true;
+}
+
+static void _add_to_list(const String &p_key, const ProgramSource &p_source) {
+	{
+		MutexLock lock(list_mutex);
+		if (!list_file || listed_keys.has(p_key)) {
+			return;
+		}
+		listed_keys.insert(p_key);
+	}
+
+	// Programs built from the same shader differ only by a few defines, they compress well.
+	Vector<uint8_t> raw = _encode_source(p_source);
+	Vector<uint8_t> compressed;
+	compressed.resize(Compression::get_max_compressed_buffer_size(raw.size(), Compression::MODE_ZSTD));
+	int size = Compression::compress(compressed.ptrw(), raw.ptr(), raw.size(), Compression::MODE_ZSTD);
+	if (size <= 0) {
+		return;
+	}
+
+	MutexLock lock(list_mutex);
+	if (list_file) {
+		list_file->store_32(size);
+		list_file->store_32(raw.size());
+		list_file->store_buffer(compressed.ptr(), size);
+	}
+}
+
+static bool _read_list_record(FileAccess *p_file, ProgramSource &r_source) {
+	uint32_t size = p_file->get_32();
+	uint32_t raw_size = p_file->get_32();
+	if (p_file->eof_reached() || size == 0 || size > MAX_LIST_RECORD || raw_size > MAX_LIST_RECORD) {
+		return false;
+	}
+
+	Vector<uint8_t> compressed;
+	compressed.resize(size);
+	if (p_file->get_buffer(compressed.ptrw(), size) != size) {
+		return false;
+	}
+
+	Vector<uint8_t> raw;
+	raw.resize(raw_size);
+	if (Compression::decompress(raw.ptrw(), raw_size, compressed.ptr(), size, Compression::MODE_ZSTD) != (int)raw_size) {
+		return false;
+	}
+	return _decode_source(raw, r_source);
+}
+
+// Links a program in the worker's context and returns its cache entry. Uses the
+// unwrapped entry points, these objects never reach the engine.
+static bool _build_entry(const ProgramSource &p_source, Vector<uint8_t> &r_entry) {
+	GLuint program = glCreateProgram();
+	Vector<GLuint> ids;
+	for (int i = 0; i < p_source.shaders.size(); i++) {
+		GLuint shader = glCreateShader(p_source.shaders[i].type);
+		const char *source = p_source.shaders[i].source.get_data();
+		__real_glShaderSource(shader, 1, &source, nullptr);
+		glCompileShader(shader);
+		__real_glAttachShader(program, shader);
+		ids.push_back(shader);
+	}
+	for (int i = 0; i < p_source.attributes.size(); i++) {
+		__real_glBindAttribLocation(program, p_source.attributes[i].index, p_source.attributes[i].name.get_data());
+	}
+	if (p_source.varyings.size()) {
+		Vector<const char *> varyings;
+		for (int i = 0; i < p_source.varyings.size(); i++) {
+			varyings.push_back(p_source.varyings[i].get_data());
+		}
+		__real_glTransformFeedbackVaryings(program, varyings.size(), varyings.ptr(), p_source.buffer_mode);
+	}
+	if (gles3) {
+		glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+	}
+	__real_glLinkProgram(program);
+
+	GLint status = GL_FALSE;
+	glGetProgramiv(program, GL_LINK_STATUS, &status);
+	bool ok = status == GL_TRUE && _get_entry(program, r_entry);
+
+	for (int i = 0; i < ids.size(); i++) {
+		__real_glDeleteShader(ids[i]);
+	}
+	__real_glDeleteProgram(program);
+	return ok;
+}
+
+static void _add_preloaded(const String &p_key, const Vector<uint8_t> &p_entry) {
+	MutexLock lock(mutex);
+	if (preloaded.has(p_key) || preloaded_bytes + p_entry.size() > PRELOAD_BUDGET) {
+		return;
+	}
+	preloaded[p_key] = p_entry;
+	preloaded_bytes += p_entry.size();
+}
+
+static void _precompile() {
+	String list_path = cache_dir.plus_file("precompile.list");
+	FileAccess *f = FileAccess::open(list_path, FileAccess::READ);
+	if (!f) {
+		return;
+	}
+	if (f->get_32() != LIST_MAGIC || f->get_32() != SHADER_CACHE_VERSION) {
+		memdelete(f);
+		return;
+	}
+
+	EGLContext context = gl_context->create_shared_context();
+	bool can_build = context != EGL_NO_CONTEXT && gl_context->make_shared_current(context);
+
+	while (!worker_exit.load(std::memory_order_acquire) && f->get_position() < f->get_len()) {
+		// Links on the render thread don't wait for the whole list.
+		_flush_writes();
+
+		ProgramSource source;
+		if (!_read_list_record(f, source)) {
+			break;
+		}
+
+		String key = _compute_key(source);
+		String path = _get_entry_path(key);
+		Vector<uint8_t> entry;
+		if (_read_entry(path, entry)) {
+			_add_preloaded(key, entry);
+		} else if (can_build && _claim_key(key)) {
+			// Otherwise the render thread is already linking it.
+			if (_build_entry(source, entry)) {
+				precompiled.fetch_add(1, std::memory_order_relaxed);
+				_write_entry(path, entry);
+				_add_preloaded(key, entry);
+			}
+			_release_key(key);
+		}
+	}
+
+	f->close();
+	memdelete(f);
+
+	if (context != EGL_NO_CONTEXT) {
+		gl_context->destroy_shared_context(context);
+	}
+}
+
+static void _worker_thread_func(void *p_udata) {
+	if (gl_context) {
+		_precompile();
+	}
+	_flush_writes();
+	_remove_stale_entries();
+
+	// Writes queued until finalize() are still stored.
+	while (!worker_exit.load(std::memory_order_acquire)) {
+		worker_semaphore.wait();
+		_flush_writes();
+	}
+	_flush_writes();
+}
+
+void ShaderCacheSwitch::initialize(bool p_gles3, ContextGLSwitchEGL *p_context) {
+	if (!GLOBAL_DEF("rendering/misc/switch/program_binary_cache", true)) {
+		return;
+	}
+	bool background_precompile = GLOBAL_DEF("rendering/misc/switch/background_precompile", true);
+
+	GLint formats = 0;
+	glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+	if (formats <= 0) {
+		print_verbose("Program binary cache disabled, the driver exposes no binary formats.");
+		return;
+	}
+
+	gles3 = p_gles3;
+	gl_get_program_binary = (GetProgramBinaryFunc)eglGetProcAddress(p_gles3 ? "glGetProgramBinary" : "glGetProgramBinaryOES");
+	gl_program_binary = (ProgramBinaryFunc)eglGetProcAddress(p_gles3 ? "glProgramBinary" : "glProgramBinaryOES");
+	if (!gl_get_program_binary || !gl_program_binary) {
+		return;
+	}
+
+	// Anything that changes the generated code has to change this hash.
+	CryptoCore::MD5Context ctx;
+	ctx.start();
+	const GLenum strings[] = { GL_VENDOR, GL_RENDERER, GL_VERSION, GL_SHADING_LANGUAGE_VERSION };
+	for (int i = 0; i < 4; i++) {
+		const char *string = (const char *)glGetString(strings[i]);
+		if (string) {
+			ctx.update((const uint8_t *)string, strlen(string) + 1);
+		}
+	}
+	const uint32_t versions[] = { hosversionGet(), SHADER_CACHE_VERSION, (uint32_t)p_gles3 };
+	ctx.update((const uint8_t *)versions, sizeof(versions));
+	ctx.finish(driver_hash);
+
+	cache_dir = OS::get_singleton()->get_user_data_dir().plus_file("shader_cache");
+	DirAccessRef da = DirAccess::create(DirAccess::ACCESS_FILESYSTEM);
+	Error err = da->make_dir_recursive(cache_dir);
+	if (err != OK && err != ERR_ALREADY_EXISTS) {
+		return;
+	}
+
+	list_file = FileAccess::open(cache_dir.plus_file("precompile.list.tmp"), FileAccess::WRITE);
+	if (list_file) {
+		list_file->store_32(LIST_MAGIC);
+		list_file->store_32(SHADER_CACHE_VERSION);
+	}
+
+	enabled.store(true, std::memory_order_release);
+
+	// Stale entries are cleared after the precompile pass, off the boot path.
+	gl_context = background_precompile ? p_context : nullptr;
+	worker_exit.store(false);
+	Thread::Settings settings;
+	settings.priority = Thread::PRIORITY_LOW;
+	worker_thread.start(_worker_thread_func, nullptr, settings);
+}
+
+void ShaderCacheSwitch::finalize() {
+	if (!enabled.exchange(false)) {
+		return;
+	}
+
+	if (worker_thread.is_started()) {
+		worker_exit.store(true, std::memory_order_release);
+		worker_semaphore.post();
+		worker_thread.wait_to_finish();
+	}
+
+	print_verbose(vformat("Program binary cache: %d hits, %d misses, %d stale, %d stored, %d built in the background.", hits.load(), misses.load(), stale.load(), stores.load(), precompiled.load()));
+
+	{
+		// Keep the previous list if this run didn't get far enough to link anything.
+		MutexLock lock(list_mutex);
+		if (list_file) {
+			bool keep = !listed_keys.empty() && list_file->get_error() == OK;
+			list_file->close();
+			memdelete(list_file);
+			list_file = nullptr;
+
+			DirAccessRef da = DirAccess::create(DirAccess::ACCESS_FILESYSTEM);
+			String tmp_path = cache_dir.plus_file("precompile.list.tmp");
+			if (!keep || da->rename(tmp_path, cache_dir.plus_file("precompile.list")) != OK) {
+				da->remove(tmp_path);
+			}
+		}
+		listed_keys.clear();
+	}
+
+	MutexLock lock(mutex);
+	shaders.clear();
+	programs.clear();
+	preloaded.clear();
+	preloaded_bytes = 0;
+	claimed_keys.clear();
+	pending_writes.clear();
+}
+
+void ShaderCacheSwitch::release_memory() {
+	{
+		// A program listed again is skipped by the worker, its entry is preloaded by then.
+		MutexLock lock(list_mutex);
+		listed_keys.clear();
+	}
+
+	// Program states have to stay, one that lost a binding would get the wrong key.
+	MutexLock lock(mutex);
+	preloaded.clear();
+	preloaded_bytes = 0;
+	shaders.clear();
+}
+
+bool ShaderCacheSwitch::is_enabled() {
+	return enabled.load(std::memory_order_acquire);
+}
+
+ShaderCacheSwitch::Stats ShaderCacheSwitch::get_stats() {
+	Stats stats;
+	stats.hits = hits.load();
+	stats.misses = misses.load();
+	stats.stale = stale.load();
+	stats.stores = stores.load();
+	stats.precompiled = precompiled.load();
+	return stats;
+}
+
+void __wrap_glShaderSource(GLuint p_shader, GLsizei p_count, const GLchar *const *p_string, const GLint *p_length) {
+	__real_glShaderSource(p_shader, p_count, p_string, p_length);
+	if (!enabled.load(std::memory_order_acquire)) {
+		return;
+	}
+
+	int total = 0;
+	for (int i = 0; i < p_count; i++) {
+		total += (p_length && p_length[i] >= 0) ? p_length[i] : strlen(p_string[i]);
+	}
+
+	ShaderState state;
+	glGetShaderiv(p_shader, GL_SHADER_TYPE, &state.type);
+	state.source.resize(total + 1);
+	char *dst = state.source.ptrw();
+	for (int i = 0; i < p_count; i++) {
+		int length = (p_length && p_length[i] >= 0) ? p_length[i] : strlen(p_string[i]);
+		memcpy(dst, p_string[i], length);
+		dst += length;
+	}
+	*dst = 0;
+
+	MutexLock lock(mutex);
+	shaders[p_shader] = state;
+}
+
+void __wrap_glAttachShader(GLuint p_program, GLuint p_shader) {
+	__real_glAttachShader(p_program, p_shader);
+	if (enabled.load(std::memory_order_acquire)) {
+		MutexLock lock(mutex);
+		programs[p_program].shaders.push_back(p_shader);
+	}
+}
+
+void __wrap_glBindAttribLocation(GLuint p_program, GLuint p_index, const GLchar *p_name) {
+	__real_glBindAttribLocation(p_program, p_index, p_name);
+	if (enabled.load(std::memory_order_acquire)) {
+		ProgramState::Attribute attribute;
+		attribute.index = p_index;
+		attribute.name = p_name;
+
+		MutexLock lock(mutex);
+		programs[p_program].attributes.push_back(attribute);
+	}
+}
+
+void __wrap_glTransformFeedbackVaryings(GLuint p_program, GLsizei p_count, const GLchar *const *p_varyings, GLenum p_buffer_mode) {
+	__real_glTransformFeedbackVaryings(p_program, p_count, p_varyings, p_buffer_mode);
+	if (enabled.load(std::memory_order_acquire)) {
+		MutexLock lock(mutex);
+		ProgramState &program = programs[p_program];
+		program.varyings.clear();
+		for (int i = 0; i < p_count; i++) {
+			program.varyings.push_back(CharString(p_varyings[i]));
+		}
+		program.buffer_mode = p_buffer_mode;
+	}
+}
+
+void __wrap_glLinkProgram(GLuint p_program) {
+	ProgramSource source;
+	bool cacheable = false;
+	Vector<uint8_t> entry;
+	String key;
+	{
+		MutexLock lock(mutex);
+		const ProgramState *program = programs.getptr(p_program);
+		if (program) {
+			cacheable = enabled.load(std::memory_order_relaxed) && _gather_source(*program, source);
+			// Only this link needs the text. A program linked again with the
+			// same shaders isn't cached, its sources are incomplete from here on.
+			for (int i = 0; i < program->shaders.size(); i++) {
+				shaders.erase(program->shaders[i]);
+			}
+		}
+		if (cacheable) {
+			key = _compute_key(source);
+			const Vector<uint8_t> *preloaded_entry = preloaded.getptr(key);
+			if (preloaded_entry) {
+				// Each binary is only needed once, the program keeps it from here on.
+				entry = *preloaded_entry;
+				preloaded_bytes -= entry.size();
+				preloaded.erase(key);
+			}
+		}
+	}
+
+	String path;
+	if (cacheable) {
+		_add_to_list(key, source);
+
+		path = _get_entry_path(key);
+		if (entry.empty()) {
+			_read_entry(path, entry);
+		}
+		if (!entry.empty()) {
+			CacheGL gl;
+			if (shader_cache_load(gl, p_program, entry.ptr(), entry.size(), driver_hash)) {
+				hits.fetch_add(1, std::memory_order_relaxed);
+				return;
+			}
+			// Rejected by the driver, it will be rebuilt below.
+			_remove_entry(path);
+		}
+	}
+
+	if (cacheable && gles3) {
+		glProgramParameteri(p_program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+	}
+	__real_glLinkProgram(p_program);
+
+	if (cacheable) {
+		misses.fetch_add(1, std::memory_order_relaxed);
+		GLint status = GL_FALSE;
+		glGetProgramiv(p_program, GL_LINK_STATUS, &status);
+		// Skipped while the worker is storing the same program.
+		if (status == GL_TRUE && _claim_key(key)) {
+			if (_get_entry(p_program, entry)) {
+				_queue_write(key, entry);
+			} else {
+				_release_key(key);
+			}
+		}
+	}
+}
+
+void __wrap_glDeleteShader(GLuint p_shader) {
+	{
+		MutexLock lock(mutex);
+		shaders.erase(p_shader);
+	}
+	__real_glDeleteShader(p_shader);
+}
+
+void __wrap_glDeleteProgram(GLuint p_program) {
+	{
+		MutexLock lock(mutex);
+		programs.erase(p_program);
+	}
+	__real_glDeleteProgram(p_program);
+}
@@ -0,0 +1,73 @@
+/**************************************************************************/
+/*  shader_cache_switch.h                                                 */
+/**************************************************************************/
+/*                         This file is part of:                          */
+/*                             GODOT ENGINE                               */
+/*                        https://godotengine.org                         */
+/**************************************************************************/
+/* Copyright (c) 2014-present Godot Engine contributors (see AUTHORS.md). */
+/* Copyright (c) 2007-2014 Juan Linietsky, Ariel Manzur.                  */
+/*                                                                        */
+/* Permission is hereby granted, free of charge, to any person obtaining  */
+/* a copy of this software and associated documentation files (the        */
+/* "Software"), to deal in the Software without restriction, including    */
+/* without limitation the rights to use, copy, modify, merge, publish,    */
+/* distribute, sublicense, and/or sell copies of the Software, and to     */
+/* permit persons to whom the Software is furnished to do so, subject to  */
+/* the following conditions:                                              */
+/*                                                                        */
+/* The above copyright notice and this permission notice shall be         */
+/* included in all copies or substantial portions of the Software.        */
+/*                                                                        */
+/* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,        */
+/* EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF     */
+/* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. */
+/* IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY   */
+/* CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,   */
+/* TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE      */
+/* SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.                 */
+/**************************************************************************/
+
+#ifndef SHADER_CACHE_SWITCH_H
+#define SHADER_CACHE_SWITCH_H
+
+#include <stdint.h>
+
+class ContextGLSwitchEGL;
+
+// Persistent GL program binary cache. The GL calls the GLES2/GLES3 shader
+// classes use to build programs are wrapped at link time: sources and bindings
+// are captured until the program links, and glLinkProgram loads a stored binary
+// when one matches instead of running the driver's compiler and linker. New
+// entries are written by the worker thread below, not at link time.
+// Entries live in user://shader_cache and are keyed by an MD5 of the program
+// sources, bindings and the driver version, so a system update invalidates them.
+//
+// Every program linked during a run is also appended to a precompile list. On the
+// next launch a worker thread with a shared context walks that list, reading the
+// stored binaries into memory and rebuilding the missing ones, so links on the
+// render thread don't wait on the SD card or the compiler.
+class ShaderCacheSwitch {
+public:
+	struct Stats {
+		uint32_t hits;
+		uint32_t misses;
+		uint32_t stale; // entries the driver rejected, or left behind by another driver
+		uint32_t stores;
+		uint32_t precompiled; // built by the background worker
+	};
+
+	// Needs the GL context to be current.
+	static void initialize(bool p_gles3, ContextGLSwitchEGL *p_context);
+	static void finalize();
+
+	// Drops binaries preloaded by the worker, they are read from disk again on
+	// demand. Also drops the sources of shaders not linked yet, those programs
+	// aren't cached, and the keys already listed for the next launch.
+	static void release_memory();
+
+	static bool is_enabled();
+	static Stats get_stats();
+};
+
+#endif // SHADER_CACHE_SWITCH_H
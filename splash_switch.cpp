@@ -0,0 +1,169 @@
+/**************************************************************************/
+/*  splash_switch.cpp                                                     */
+/**************************************************************************/
+/*                         This file is part of:                          */
+/*                             GODOT ENGINE                               */
+/*                        https://godotengine.org                         */
+/**************************************************************************/
+/* Copyright (c) 2014-present Godot Engine contributors (see AUTHORS.md). */
+/* Copyright (c) 2007-2014 Juan Linietsky, Ariel Manzur.                  */
+/*                                                                        */
+/* Permission is hereby granted, free of charge, to any person obtaining  */
+/* a copy of this software and associated documentation files (the        */
+/* "Software"), to deal in the Software without restriction, including    */
+/* without limitation the rights to use, copy, modify, merge, publish,    */
+/* distribute, sublicense, and/or sell copies of the Software, and to     */
+/* permit persons to whom the Software is furnished to do so, subject to  */
+/* the following conditions:                                              */
+/*                                                                        */
+/* The above copyright notice and this permission notice shall be         */
+/* included in all copies or substantial portions of the Software.        */
+/*                                                                        */
+/* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,        */
+/* EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF     */
+/* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. */
+/* IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY   */
+/* CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,   */
+/* TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE      */
+/* SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.                 */
+/**************************************************************************/
+
+#include "splash_switch.h"
+
+#include <limits.h>
+#include <stdio.h>
+#include <string.h>
+#include <zlib.h>
+#include <zstd.h>
+
+#define SPLASH_READ_CHUNK 0x4000
+
+static bool _decode_gzip(FILE *p_file, u8 *p_out, size_t p_out_size) {
+	u8 in[SPLASH_READ_CHUNK];
+
+	z_stream stream;
+	memset(&stream, 0, sizeof(stream));
+	if (inflateInit2(&stream, 16 + MAX_WBITS) != Z_OK) {
+		return false;
+	}
+	stream.next_out = p_out;
+	stream.avail_out = p_out_size;
+
+	int err = Z_OK;
+	while (err != Z_STREAM_END) {
+		if (stream.avail_in == 0) {
+			size_t read = fread(in, 1, sizeof(in), p_file);
+			if (read == 0) {
+				break; // truncated or unreadable
+			}
+			stream.next_in = in;
+			stream.avail_in = read;
+		}
+
+		err = inflate(&stream, Z_NO_FLUSH);
+		if (err != Z_OK && err != Z_STREAM_END) {
+			break; // corrupt, or larger than the framebuffer
+		}
+	}
+
+	inflateEnd(&stream);
+	return err == Z_STREAM_END && stream.avail_out == 0;
+}
+
+static bool _decode_zstd(FILE *p_file, u8 *p_out, size_t p_out_size) {
+	u8 in[SPLASH_READ_CHUNK];
+
+	ZSTD_DStream *stream = ZSTD_createDStream();
+	if (!stream) {
+		return false;
+	}
+	ZSTD_initDStream(stream);
+
+	ZSTD_inBuffer input = { in, 0, 0 };
+	ZSTD_outBuffer output = { p_out, p_out_size, 0 };
+	size_t ret = 1;
+	while (ret != 0) {
+		if (input.pos == input.size) {
+			size_t read = fread(in, 1, sizeof(in), p_file);
+			if (read == 0) {
+				break;
+			}
+			input.size = read;
+			input.pos = 0;
+		}
+
+		// A full output isn't the end yet, the frame may still have its
+		// epilogue to read. It's only too large if the stream stops moving.
+		size_t in_pos = input.pos;
+		size_t out_pos = output.pos;
+		ret = ZSTD_decompressStream(stream, &output, &input);
+		if (ZSTD_isError(ret)) {
+			break;
+		}
+		if (ret != 0 && output.pos == output.size && input.pos == in_pos && output.pos == out_pos) {
+			break; // larger than the framebuffer
+		}
+	}
+
+	ZSTD_freeDStream(stream);
+	return ret == 0 && output.pos == output.size;
+}
+
+static FILE *_open_splash(const char *p_base_path, bool &r_zstd) {
+	char path[PATH_MAX];
+	snprintf(path, sizeof(path), "%s.rgba.zst", p_base_path);
+	FILE *splash = fopen(path, "rb");
+	r_zstd = splash != NULL;
+	if (!splash) {
+		snprintf(path, sizeof(path), "%s.rgba.gz", p_base_path);
+		splash = fopen(path, "rb");
+	}
+	if (splash) {
+		// We read in chunks larger than stdio's buffer, don't copy through it.
+		setvbuf(splash, NULL, _IONBF, 0);
+	}
+	return splash;
+}
+
+static Framebuffer splash_fb;
+static bool splash_fb_open = false;
+
+bool splash_switch_show(const char *p_base_path, u32 p_width, u32 p_height) {
+	bool zstd;
+	FILE *splash = _open_splash(p_base_path, zstd);
+	if (!splash) {
+		return false;
+	}
+
+	splash_switch_close();
+	if (R_FAILED(framebufferCreate(&splash_fb, nwindowGetDefault(), p_width, p_height, PIXEL_FORMAT_RGBA_8888, 1))) {
+		fclose(splash);
+		return false;
+	}
+	framebufferMakeLinear(&splash_fb);
+	splash_fb_open = true;
+
+	u32 stride;
+	u32 *framebuf = (u32 *)framebufferBegin(&splash_fb, &stride);
+	size_t size = (size_t)stride * p_height;
+
+	bool ok = false;
+	// The splash is stored without padding, we only decode straight into unpadded buffers.
+	if (stride == p_width * sizeof(u32)) {
+		ok = zstd ? _decode_zstd(splash, (u8 *)framebuf, size) : _decode_gzip(splash, (u8 *)framebuf, size);
+	}
+	fclose(splash);
+
+	if (!ok) {
+		memset(framebuf, 0, size);
+	}
+	framebufferEnd(&splash_fb);
+	return ok;
+}
+
+void splash_switch_close() {
+	if (splash_fb_open) {
+		framebufferClose(&splash_fb);
+		splash_fb_open = false;
+	}
+}
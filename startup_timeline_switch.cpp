@@ -0,0 +1,129 @@
+/**************************************************************************/
+/*  startup_timeline_switch.cpp                                           */
+/**************************************************************************/
+/*                         This file is part of:                          */
+/*                             GODOT ENGINE                               */
+/*                        https://godotengine.org                         */
+/**************************************************************************/
+/* Copyright (c) 2014-present Godot Engine contributors (see AUTHORS.md). */
+/* Copyright (c) 2007-2014 Juan Linietsky, Ariel Manzur.                  */
+/*                                                                        */
+/* Permission is hereby granted, free of charge, to any person obtaining  */
+/* a copy of this software and associated documentation files (the        */
+/* "Software"), to deal in the Software without restriction, including    */
+/* without limitation the rights to use, copy, modify, merge, publish,    */
+/* distribute, sublicense, and/or sell copies of the Software, and to     */
+/* permit persons to whom the Software is furnished to do so, subject to  */
+/* the following conditions:                                              */
+/*                                                                        */
+/* The above copyright notice and this permission notice shall be         */
+/* included in all copies or substantial portions of the Software.        */
+/*                                                                        */
+/* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,        */
+/* EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF     */
+/* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. */
+/* IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY   */
+/* CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,   */
+/* TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE      */
+/* SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.                 */
+/**************************************************************************/
+
+#include "startup_timeline_switch.h"
+
+#include "core/os/file_access.h"
+#include "core/print_string.h"
+#include "switch_wrapper.h"
+
+#define MAX_PHASES 64
+#define MAX_DEPTH 8
+
+struct Phase {
+	const char *name;
+	u64 start_tick;
+	u64 end_tick;
+	int depth;
+};
+
+static Phase phases[MAX_PHASES];
+static int phase_count = 0;
+static int open_phases[MAX_DEPTH];
+static int depth = 0;
+static int skipped_depth = 0; // begin() calls past the limits, their end() must not close a recorded phase
+
+static uint64_t _ticks_to_usec(u64 p_ticks) {
+	return armTicksToNs(p_ticks) / 1000;
+}
+
+void StartupTimelineSwitch::begin(const char *p_name) {
+	if (skipped_depth > 0 || phase_count >= MAX_PHASES || depth >= MAX_DEPTH) {
+		skipped_depth++;
+		return;
+	}
+	Phase &phase = phases[phase_count];
+	phase.name = p_name;
+	phase.start_tick = armGetSystemTick();
+	phase.end_tick = 0;
+	phase.depth = depth;
+	open_phases[depth++] = phase_count++;
+}
+
+void StartupTimelineSwitch::end() {
+	if (skipped_depth > 0) {
+		skipped_depth--;
+		return;
+	}
+	if (depth == 0) {
+		return;
+	}
+	phases[open_phases[--depth]].end_tick = armGetSystemTick();
+}
+
+void StartupTimelineSwitch::print_summary() {
+	if (phase_count == 0) {
+		return;
+	}
+	u64 origin = phases[0].start_tick;
+	u64 last = origin;
+
+	print_line("Startup timeline:");
+	for (int i = 0; i < phase_count; i++) {
+		const Phase &phase = phases[i];
+		if (phase.end_tick == 0) {
+			continue;
+		}
+		last = MAX(last, phase.end_tick);
+		String indent = "  ";
+		for (int j = 0; j < phase.depth; j++) {
+			indent += "  ";
+		}
+		print_line(indent + phase.name + ": " + rtos(_ticks_to_usec(phase.end_tick - phase.start_tick) / 1000.0) + " ms (at " + rtos(_ticks_to_usec(phase.start_tick - origin) / 1000.0) + " ms)");
+	}
+	print_line("  total: " + rtos(_ticks_to_usec(last - origin) / 1000.0) + " ms");
+}
+
+Error StartupTimelineSwitch::save_chrome_trace(const String &p_path) {
+	FileAccess *f = FileAccess::open(p_path, FileAccess::WRITE);
+	ERR_FAIL_COND_V_MSG(!f, ERR_CANT_CREATE, "Cannot write startup trace to '" + p_path + "'.");
+
+	u64 origin = phase_count > 0 ? phases[0].start_tick : 0;
+	f->store_string("{\"traceEvents\":[\n");
+	bool first = true;
+	for (int i = 0; i < phase_count; i++) {
+		const Phase &phase = phases[i];
+		if (phase.end_tick == 0) {
+			continue;
+		}
+		if (!first) {
+			f->store_string(",\n");
+		}
+		first = false;
+		f->store_string(vformat("{\"name\":\"%s\",\"cat\":\"startup\",\"ph\":\"X\",\"pid\":1,\"tid\":1,\"ts\":%d,\"dur\":%d}",
+				String(phase.name).json_escape(),
+				(int64_t)_ticks_to_usec(phase.start_tick - origin),
+				(int64_t)_ticks_to_usec(phase.end_tick - phase.start_tick)));
+	}
+	f->store_string("\n],\"displayTimeUnit\":\"ms\"}\n");
+	f->close();
+	memdelete(f);
+	return OK;
+}
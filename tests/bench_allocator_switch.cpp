@@ -0,0 +1,470 @@
+/**************************************************************************/
+/*  bench_allocator_switch.cpp                                            */
+/**************************************************************************/
+/*                         This file is part of:                          */
+/*                             GODOT ENGINE                               */
+/*                        https://godotengine.org                         */
+/**************************************************************************/
+/* Copyright (c) 2014-present Godot Engine contributors (see AUTHORS.md). */
+/* Copyright (c) 2007-2014 Juan Linietsky, Ariel Manzur.                  */
+/*                                                                        */
+/* Permission is hereby granted, free of charge, to any person obtaining  */
+/* a copy of this software and associated documentation files (the        */
+/* "Software"), to deal in the Software without restriction, including    */
+/* without limitation the rights to use, copy, modify, merge, publish,    */
+/* distribute, sublicense, and/or sell copies of the Software, and to     */
+/* permit persons to whom the Software is furnished to do so, subject to  */
+/* the following conditions:                                              */
+/*                                                                        */
+/* The above copyright notice and this permission notice shall be         */
+/* included in all copies or substantial portions of the Software.        */
+/*                                                                        */
+/* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,        */
+/* EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF     */
+/* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. */
+/* IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY   */
+/* CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,   */
+/* TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE      */
+/* SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.                 */
+/**************************************************************************/
+
+// Host benchmark for allocator_switch.cpp: replays an allocation trace once
+// through the C heap alone and once through the arena allocator, each in its own
+// process, checking block contents and reporting time and heap footprint.
+// glibc is kept on brk so its heap is one contiguous range, like newlib's, and
+// the arena gets a mapped range of its own as the fake heap. The benchmark's
+// own data is allocated before a run starts and isn't counted.
+//
+// Build and run from this directory:
+//   c++ -std=c++11 -O2 -DSWITCH_ARENA_ALLOCATOR_ENABLED -I.. bench_allocator_switch.cpp ../allocator_switch.cpp
+//       -Wl,--wrap=malloc,--wrap=free,--wrap=calloc,--wrap=realloc,--wrap=malloc_usable_size -lpthread -o bench_allocator_switch
+//   ./bench_allocator_switch [trace.txt] [--write-trace out.txt]
+//
+// A trace has one operation per line, ids are arbitrary integers:
+//   a <id> <size>    malloc
+//   r <id> <size>    realloc
+//   f <id>           free
+//   m <n>            checkpoint, e.g. a level change, where the footprint is sampled
+// Without a trace file a synthetic session is generated: a series of levels,
+// each loading a burst of small objects skewed towards different size classes,
+// keeping a few of them and freeing the rest.
+
+#include "allocator_switch.h"
+
+#include <malloc.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+#include <algorithm>
+#include <vector>
+
+extern "C" {
+char *fake_heap_start = NULL;
+char *fake_heap_end = NULL;
+
+void *__real_malloc(size_t p_size);
+void __real_free(void *p_ptr);
+void *__real_realloc(void *p_ptr, size_t p_size);
+}
+
+struct Op {
+	char type;
+	uint32_t id;
+	uint32_t size;
+};
+
+struct Block {
+	uint8_t *ptr;
+	uint32_t size;
+};
+
+struct Allocator {
+	const char *name;
+	void *(*alloc)(size_t);
+	void *(*resize)(void *, size_t);
+	void (*release)(void *);
+};
+
+static void *arena_malloc(size_t p_size) { return malloc(p_size); }
+static void *arena_realloc(void *p_ptr, size_t p_size) { return realloc(p_ptr, p_size); }
+static void arena_free(void *p_ptr) { free(p_ptr); }
+
+static const Allocator allocators[] = {
+	{ "newlib-like", __real_malloc, __real_realloc, __real_free },
+	{ "arena", arena_malloc, arena_realloc, arena_free },
+};
+
+static uint64_t baseline_footprint = 0;
+static uint64_t baseline_in_use = 0;
+
+// The arena takes its region on the first malloc, which may come before main.
+__attribute__((constructor(101))) static void map_fake_heap() {
+	size_t size = (size_t)4 << 30;
+	fake_heap_start = (char *)mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+	if (fake_heap_start == MAP_FAILED) {
+		abort();
+	}
+	fake_heap_end = fake_heap_start + size;
+}
+
+/* Traces */
+
+static uint64_t rng_state = 0x9E3779B97F4A7C15ull;
+
+static uint32_t rng() {
+	rng_state ^= rng_state << 13;
+	rng_state ^= rng_state >> 7;
+	rng_state ^= rng_state << 17;
+	return (uint32_t)rng_state;
+}
+
+static uint32_t small_size(uint32_t p_center) {
+	// Mostly around p_center, with a tail over the whole small range.
+	if (rng() % 4 == 0) {
+		return 8 + rng() % 1016;
+	}
+	uint32_t spread = p_center / 4 + 8;
+	return p_center - spread / 2 + rng() % spread;
+}
+
+static std::vector<Op> generate_session() {
+	static const uint32_t level_centers[] = { 32, 512, 96, 1000, 48, 256, 768, 24, 640, 128, 384, 900 };
+	std::vector<Op> ops;
+	std::vector<uint32_t> live;
+	uint32_t next_id = 1;
+
+	for (uint32_t level = 0; level < 3 * sizeof(level_centers) / sizeof(level_centers[0]); level++) {
+		uint32_t center = level_centers[level % (sizeof(level_centers) / sizeof(level_centers[0]))];
+		std::vector<uint32_t> transient;
+
+		for (int i = 0; i < 120000; i++) {
+			Op op;
+			op.type = 'a';
+			op.id = next_id++;
+			op.size = rng() % 50 == 0 ? 2048 + rng() % 65536 : small_size(center);
+			ops.push_back(op);
+
+			// About 2% outlives the level (caches, autoloads, leaks).
+			if (rng() % 50 == 0) {
+				live.push_back(op.id);
+			} else {
+				transient.push_back(op.id);
+			}
+
+			// Churn during the level: strings growing, temporaries.
+			if (transient.size() > 16 && rng() % 3 == 0) {
+				size_t victim = rng() % transient.size();
+				Op churn;
+				churn.id = transient[victim];
+				if (rng() % 4 == 0) {
+					churn.type = 'r';
+					churn.size = small_size(center) * 2;
+				} else {
+					churn.type = 'f';
+					churn.size = 0;
+					transient[victim] = transient.back();
+					transient.pop_back();
+				}
+				ops.push_back(churn);
+			}
+		}
+
+		// Level unload, in allocation order with some shuffling.
+		for (size_t i = 0; i < transient.size(); i++) {
+			size_t j = i + rng() % (transient.size() - i);
+			uint32_t id = transient[j];
+			transient[j] = transient[i];
+			Op op = { 'f', id, 0 };
+			ops.push_back(op);
+		}
+		Op mark = { 'm', level, 0 };
+		ops.push_back(mark);
+	}
+
+	for (size_t i = 0; i < live.size(); i++) {
+		Op op = { 'f', live[i], 0 };
+		ops.push_back(op);
+	}
+	return ops;
+}
+
+static bool read_trace(const char *p_path, std::vector<Op> &r_ops) {
+	FILE *f = fopen(p_path, "r");
+	if (!f) {
+		return false;
+	}
+	char type;
+	unsigned id;
+	unsigned size;
+	char line[128];
+	while (fgets(line, sizeof(line), f)) {
+		size = 0;
+		if (sscanf(line, " %c %u %u", &type, &id, &size) < 2) {
+			continue;
+		}
+		Op op = { type, id, size };
+		r_ops.push_back(op);
+	}
+	fclose(f);
+	return true;
+}
+
+// Numbers the ids from 0, so replays can keep blocks in a flat table instead of
+// allocating for their bookkeeping. Returns the table size.
+static uint32_t index_ids(std::vector<Op> &r_ops) {
+	std::vector<uint32_t> ids;
+	for (size_t i = 0; i < r_ops.size(); i++) {
+		if (r_ops[i].type != 'm') {
+			ids.push_back(r_ops[i].id);
+		}
+	}
+	std::sort(ids.begin(), ids.end());
+	ids.erase(std::unique(ids.begin(), ids.end()), ids.end());
+
+	for (size_t i = 0; i < r_ops.size(); i++) {
+		if (r_ops[i].type != 'm') {
+			r_ops[i].id = (uint32_t)(std::lower_bound(ids.begin(), ids.end(), r_ops[i].id) - ids.begin());
+		}
+	}
+	return (uint32_t)ids.size();
+}
+
+static void write_trace(const char *p_path, const std::vector<Op> &p_ops) {
+	FILE *f = fopen(p_path, "w");
+	if (!f) {
+		return;
+	}
+	for (size_t i = 0; i < p_ops.size(); i++) {
+		if (p_ops[i].type == 'f' || p_ops[i].type == 'm') {
+			fprintf(f, "%c %u\n", p_ops[i].type, p_ops[i].id);
+		} else {
+			fprintf(f, "%c %u %u\n", p_ops[i].type, p_ops[i].id, p_ops[i].size);
+		}
+	}
+	fclose(f);
+}
+
+/* Replay */
+
+static uint64_t now_usec() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static uint8_t pattern(uint32_t p_id) {
+	return (uint8_t)(p_id * 131 + 7);
+}
+
+static bool check_block(uint32_t p_id, const Block &p_block) {
+	// First and last bytes are enough to catch overlapping blocks.
+	uint32_t n = p_block.size < 16 ? p_block.size : 16;
+	for (uint32_t i = 0; i < n; i++) {
+		if (p_block.ptr[i] != pattern(p_id) || p_block.ptr[p_block.size - 1 - i] != pattern(p_id)) {
+			return false;
+		}
+	}
+	return true;
+}
+
+// Both count glibc and the arena, only one of them is in use past the baseline.
+static uint64_t heap_footprint() {
+	return (uint64_t)(uintptr_t)sbrk(0) + AllocatorSwitch::get_stats().reserved_bytes - baseline_footprint;
+}
+
+static uint64_t heap_in_use() {
+	struct mallinfo2 mi = mallinfo2();
+	return mi.uordblks + AllocatorSwitch::get_stats().used_bytes - baseline_in_use;
+}
+
+// What the heap holds on top of the live data.
+static void sample(uint64_t p_live_bytes, uint64_t &r_peak_footprint, uint64_t &r_worst_overhead) {
+	uint64_t footprint = heap_footprint();
+	uint64_t in_use = heap_in_use();
+	uint64_t overhead = in_use > p_live_bytes ? in_use - p_live_bytes : 0;
+	r_peak_footprint = footprint > r_peak_footprint ? footprint : r_peak_footprint;
+	r_worst_overhead = overhead > r_worst_overhead ? overhead : r_worst_overhead;
+}
+
+static int replay(const Allocator &p_allocator, const std::vector<Op> &p_ops, uint32_t p_block_count) {
+	std::vector<Block> blocks(p_block_count, Block());
+	baseline_footprint = heap_footprint();
+	baseline_in_use = heap_in_use();
+
+	uint64_t live_bytes = 0;
+	uint64_t peak_footprint = 0;
+	uint64_t worst_overhead = 0;
+	uint64_t elapsed = 0;
+	uint64_t start = now_usec();
+
+	for (size_t i = 0; i < p_ops.size(); i++) {
+		const Op &op = p_ops[i];
+		if (op.type == 'm') {
+			elapsed += now_usec() - start;
+			sample(live_bytes, peak_footprint, worst_overhead);
+			start = now_usec();
+			continue;
+		}
+
+		Block &block = blocks[op.id];
+		if (op.type == 'a' && !block.ptr && op.size > 0) {
+			block.size = op.size;
+			block.ptr = (uint8_t *)p_allocator.alloc(op.size);
+			if (!block.ptr) {
+				fprintf(stderr, "%s: out of memory\n", p_allocator.name);
+				return 1;
+			}
+			memset(block.ptr, pattern(op.id), op.size);
+			live_bytes += op.size;
+		} else if (op.type == 'r' && block.ptr && op.size > 0) {
+			if (!check_block(op.id, block)) {
+				fprintf(stderr, "%s: block %u corrupted\n", p_allocator.name, op.id);
+				return 1;
+			}
+			uint8_t *ptr = (uint8_t *)p_allocator.resize(block.ptr, op.size);
+			if (!ptr) {
+				fprintf(stderr, "%s: out of memory\n", p_allocator.name);
+				return 1;
+			}
+			live_bytes = live_bytes - block.size + op.size;
+			block.ptr = ptr;
+			block.size = op.size;
+			memset(block.ptr, pattern(op.id), op.size);
+		} else if (op.type == 'f' && block.ptr) {
+			if (!check_block(op.id, block)) {
+				fprintf(stderr, "%s: block %u corrupted\n", p_allocator.name, op.id);
+				return 1;
+			}
+			live_bytes -= block.size;
+			p_allocator.release(block.ptr);
+			block.ptr = NULL;
+		}
+	}
+	elapsed += now_usec() - start;
+	sample(live_bytes, peak_footprint, worst_overhead);
+
+	for (size_t i = 0; i < blocks.size(); i++) {
+		if (blocks[i].ptr) {
+			p_allocator.release(blocks[i].ptr);
+		}
+	}
+
+	printf("%-12s %8.1f ms  %6.2f MiB peak heap  %6.2f MiB worst overhead at a checkpoint\n", p_allocator.name, elapsed / 1000.0, peak_footprint / 1048576.0, worst_overhead / 1048576.0);
+	return 0;
+}
+
+/* Cross-thread frees, which go through the thread caches */
+
+#define STRESS_THREADS 4
+#define STRESS_ROUNDS 200000
+#define STRESS_SLOTS 4096
+
+static void *volatile stress_slots[STRESS_SLOTS];
+static pthread_mutex_t stress_mutex = PTHREAD_MUTEX_INITIALIZER;
+static volatile bool stress_failed = false;
+
+static void *stress_thread(void *p_arg) {
+	uint64_t state = (uintptr_t)p_arg * 0x2545F4914F6CDD1Dull + 1;
+	for (int i = 0; i < STRESS_ROUNDS; i++) {
+		state ^= state << 13;
+		state ^= state >> 7;
+		state ^= state << 17;
+		uint32_t size = 8 + state % 1016;
+		uint8_t *ptr = (uint8_t *)malloc(size + 8);
+		memcpy(ptr, &size, 4);
+		memset(ptr + 4, (uint8_t)size, size);
+
+		// Swap it into a shared slot, freeing whatever another thread left there.
+		pthread_mutex_lock(&stress_mutex);
+		uint32_t slot = (state >> 32) % STRESS_SLOTS;
+		uint8_t *old = (uint8_t *)stress_slots[slot];
+		stress_slots[slot] = ptr;
+		pthread_mutex_unlock(&stress_mutex);
+
+		if (old) {
+			uint32_t old_size;
+			memcpy(&old_size, old, 4);
+			if (old[4] != (uint8_t)old_size || old[4 + old_size - 1] != (uint8_t)old_size) {
+				stress_failed = true;
+			}
+			free(old);
+		}
+	}
+	return NULL;
+}
+
+static int stress() {
+	uint64_t start = now_usec();
+	pthread_t threads[STRESS_THREADS];
+	for (uintptr_t i = 0; i < STRESS_THREADS; i++) {
+		pthread_create(&threads[i], NULL, stress_thread, (void *)(i + 1));
+	}
+	for (int i = 0; i < STRESS_THREADS; i++) {
+		pthread_join(threads[i], NULL);
+	}
+	for (int i = 0; i < STRESS_SLOTS; i++) {
+		free(stress_slots[i]);
+	}
+	printf("%-12s %8.1f ms  %d threads freeing each other's blocks%s\n", "arena", (now_usec() - start) / 1000.0, STRESS_THREADS, stress_failed ? ", CORRUPTED" : "");
+	return stress_failed ? 1 : 0;
+}
+
+int main(int argc, char **argv) {
+	// Keep the trace off brk, the runs start from the same heap.
+	mallopt(M_MMAP_THRESHOLD, 4096);
+
+	const char *trace_path = NULL;
+	const char *write_path = NULL;
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "--write-trace") == 0 && i + 1 < argc) {
+			write_path = argv[++i];
+		} else {
+			trace_path = argv[i];
+		}
+	}
+
+	std::vector<Op> ops;
+	if (trace_path) {
+		if (!read_trace(trace_path, ops)) {
+			fprintf(stderr, "Can't read %s\n", trace_path);
+			return 1;
+		}
+	} else {
+		ops = generate_session();
+	}
+	if (write_path) {
+		write_trace(write_path, ops);
+	}
+	uint32_t block_count = index_ids(ops);
+	printf("Replaying %zu operations.\n", ops.size());
+	fflush(stdout);
+
+	int result = 0;
+	for (size_t i = 0; i < sizeof(allocators) / sizeof(allocators[0]); i++) {
+		pid_t pid = fork();
+		if (pid == 0) {
+			// Keep the replay on brk, the arena has its own range already.
+			mallopt(M_MMAP_THRESHOLD, 32 * 1024 * 1024);
+			mallopt(M_TRIM_THRESHOLD, 128 * 1024);
+
+			int status = replay(allocators[i], ops, block_count);
+			if (status == 0 && i == 1) {
+				status = stress();
+			}
+			fflush(stdout);
+			_exit(status);
+		}
+
+		int status = 1;
+		waitpid(pid, &status, 0);
+		if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+			result = 1;
+		}
+	}
+	return result;
+}
@@ -0,0 +1,250 @@
+/**************************************************************************/
+/*  test_shader_cache_switch.cpp                                          */
+/**************************************************************************/
+/*                         This file is part of:                          */
+/*                             GODOT ENGINE                               */
+/*                        https://godotengine.org                         */
+/**************************************************************************/
+/* Copyright (c) 2014-present Godot Engine contributors (see AUTHORS.md). */
+/* Copyright (c) 2007-2014 Juan Linietsky, Ariel Manzur.                  */
+/*                                                                        */
+/* Permission is hereby granted, free of charge, to any person obtaining  */
+/* a copy of this software and associated documentation files (the        */
+/* "Software"), to deal in the Software without restriction, including    */
+/* without limitation the rights to use, copy, modify, merge, publish,    */
+/* distribute, sublicense, and/or sell copies of the Software, and to     */
+/* permit persons to whom the Software is furnished to do so, subject to  */
+/* the following conditions:                                              */
+/*                                                                        */
+/* The above copyright notice and this permission notice shall be         */
+/* included in all copies or substantial portions of the Software.        */
+/*                                                                        */
+/* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,        */
+/* EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF     */
+/* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. */
+/* IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY   */
+/* CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,   */
+/* TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE      */
+/* SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.                 */
+/**************************************************************************/
+
+// Host test of the program binary cache entry logic against a stub GL.
+// Build and run from this directory:
+//   c++ -std=c++11 -Wall -I.. test_shader_cache_switch.cpp -o test_shader_cache_switch && ./test_shader_cache_switch
+
+#include "shader_cache_entry_switch.h"
+
+#include <stddef.h>
+#include <stdio.h>
+#include <map>
+#include <vector>
+
+static int failures = 0;
+
+#define CHECK(m_cond)                                                   \
+	do {                                                                \
+		if (!(m_cond)) {                                                \
+			printf("%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #m_cond); \
+			failures++;                                                 \
+		}                                                               \
+	} while (0)
+
+// Stands in for the driver: a linked program's "binary" is its source bytes,
+// prefixed with the driver build so binaries from another build are rejected.
+struct StubGL {
+	struct Program {
+		std::vector<uint8_t> binary;
+		bool linked = false;
+	};
+
+	std::map<uint32_t, Program> programs;
+	uint8_t build = 1;
+	uint32_t format = 0x1234;
+	int32_t short_by = 0; // binary comes out shorter than binary_length() announced
+	int program_binary_calls = 0;
+
+	void link_from_source(uint32_t p_program, const char *p_source) {
+		Program &program = programs[p_program];
+		program.binary.assign(1, build);
+		program.binary.insert(program.binary.end(), p_source, p_source + strlen(p_source));
+		program.linked = true;
+	}
+
+	int32_t binary_length(uint32_t p_program) {
+		const Program &program = programs[p_program];
+		return program.linked ? (int32_t)program.binary.size() : 0;
+	}
+
+	int32_t get_binary(uint32_t p_program, int32_t p_size, uint32_t *r_format, uint8_t *r_dst) {
+		const Program &program = programs[p_program];
+		int32_t length = (int32_t)program.binary.size() - short_by;
+		if (!program.linked || length > p_size) {
+			return 0;
+		}
+		memcpy(r_dst, program.binary.data(), length);
+		*r_format = format;
+		return length;
+	}
+
+	void program_binary(uint32_t p_program, uint32_t p_format, const uint8_t *p_src, int32_t p_length) {
+		program_binary_calls++;
+		Program &program = programs[p_program];
+		program.linked = p_format == format && p_length > 0 && p_src[0] == build;
+		program.binary.assign(p_src, p_src + p_length);
+	}
+
+	bool link_status(uint32_t p_program) {
+		return programs[p_program].linked;
+	}
+};
+
+static const uint8_t driver_a[16] = { 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16 };
+static const uint8_t driver_b[16] = { 16, 15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1 };
+
+static std::vector<uint8_t> store(StubGL &p_gl, uint32_t p_program, const uint8_t *p_driver_hash) {
+	std::vector<uint8_t> entry(shader_cache_entry_size(p_gl, p_program));
+	if (entry.empty()) {
+		return entry;
+	}
+	entry.resize(shader_cache_store(p_gl, p_program, p_driver_hash, entry.data(), entry.size()));
+	return entry;
+}
+
+static void test_round_trip() {
+	StubGL gl;
+	gl.link_from_source(1, "void main() {}");
+	std::vector<uint8_t> entry = store(gl, 1, driver_a);
+	CHECK(entry.size() == sizeof(ShaderCacheEntryHeader) + 1 + strlen("void main() {}"));
+
+	uint32_t format = 0;
+	uint32_t length = 0;
+	const uint8_t *payload = shader_cache_parse_entry(entry.data(), entry.size(), driver_a, format, length);
+	CHECK(payload != nullptr);
+	CHECK(format == gl.format);
+	CHECK(length == gl.programs[1].binary.size());
+	CHECK(payload && memcmp(payload, gl.programs[1].binary.data(), length) == 0);
+
+	// A fresh program picks the binary up without being linked from source.
+	CHECK(shader_cache_load(gl, 2, entry.data(), entry.size(), driver_a));
+	CHECK(gl.programs[2].binary == gl.programs[1].binary);
+}
+
+static void test_unlinked_program_is_not_stored() {
+	StubGL gl;
+	CHECK(shader_cache_entry_size(gl, 1) == 0);
+
+	uint8_t buffer[64];
+	CHECK(shader_cache_store(gl, 1, driver_a, buffer, sizeof(buffer)) == 0);
+	CHECK(shader_cache_store(gl, 1, driver_a, buffer, sizeof(ShaderCacheEntryHeader)) == 0);
+}
+
+static void test_short_binary() {
+	StubGL gl;
+	gl.link_from_source(1, "void main() { gl_Position = vec4(0.0); }");
+	gl.short_by = 4;
+	std::vector<uint8_t> entry = store(gl, 1, driver_a);
+	CHECK(entry.size() == sizeof(ShaderCacheEntryHeader) + gl.programs[1].binary.size() - 4);
+
+	uint32_t format;
+	uint32_t length;
+	CHECK(shader_cache_parse_entry(entry.data(), entry.size(), driver_a, format, length) != nullptr);
+}
+
+static void test_other_driver_is_stale() {
+	StubGL gl;
+	gl.link_from_source(1, "void main() {}");
+	std::vector<uint8_t> entry = store(gl, 1, driver_a);
+
+	CHECK(!shader_cache_load(gl, 2, entry.data(), entry.size(), driver_b));
+	CHECK(gl.program_binary_calls == 0);
+
+	ShaderCacheEntryHeader header;
+	memcpy(&header, entry.data(), sizeof(header));
+	CHECK(shader_cache_check_header(header, driver_a));
+	CHECK(!shader_cache_check_header(header, driver_b));
+}
+
+static void test_other_version_is_stale() {
+	StubGL gl;
+	gl.link_from_source(1, "void main() {}");
+	std::vector<uint8_t> entry = store(gl, 1, driver_a);
+
+	std::vector<uint8_t> bad_magic = entry;
+	bad_magic[0] ^= 0xFF;
+	CHECK(!shader_cache_load(gl, 2, bad_magic.data(), bad_magic.size(), driver_a));
+
+	std::vector<uint8_t> bad_version = entry;
+	bad_version[offsetof(ShaderCacheEntryHeader, version)]++;
+	CHECK(!shader_cache_load(gl, 2, bad_version.data(), bad_version.size(), driver_a));
+	CHECK(gl.program_binary_calls == 0);
+}
+
+static void test_damaged_entries_are_rejected() {
+	StubGL gl;
+	gl.link_from_source(1, "void main() {}");
+	std::vector<uint8_t> entry = store(gl, 1, driver_a);
+	uint32_t format;
+	uint32_t length;
+
+	// Interrupted write.
+	for (size_t size = 0; size < entry.size(); size++) {
+		CHECK(shader_cache_parse_entry(entry.data(), size, driver_a, format, length) == nullptr);
+	}
+
+	// Trailing garbage.
+	std::vector<uint8_t> longer = entry;
+	longer.push_back(0);
+	CHECK(shader_cache_parse_entry(longer.data(), longer.size(), driver_a, format, length) == nullptr);
+
+	// Bit rot in the payload.
+	std::vector<uint8_t> flipped = entry;
+	flipped.back() ^= 0x01;
+	CHECK(shader_cache_parse_entry(flipped.data(), flipped.size(), driver_a, format, length) == nullptr);
+
+	CHECK(shader_cache_parse_entry(nullptr, 0, driver_a, format, length) == nullptr);
+	CHECK(!shader_cache_load(gl, 2, flipped.data(), flipped.size(), driver_a));
+	CHECK(gl.program_binary_calls == 0);
+}
+
+static void test_driver_rejection() {
+	// Same driver hash, but the driver refuses the binary (e.g. a driver
+	// update that kept its version strings): the load reports a miss.
+	StubGL gl;
+	gl.link_from_source(1, "void main() {}");
+	std::vector<uint8_t> entry = store(gl, 1, driver_a);
+
+	gl.build = 2;
+	CHECK(!shader_cache_load(gl, 2, entry.data(), entry.size(), driver_a));
+	CHECK(gl.program_binary_calls == 1);
+	CHECK(!gl.link_status(2));
+
+	// Relinking from source produces an entry the driver accepts again.
+	gl.link_from_source(2, "void main() {}");
+	std::vector<uint8_t> rebuilt = store(gl, 2, driver_a);
+	CHECK(shader_cache_load(gl, 3, rebuilt.data(), rebuilt.size(), driver_a));
+}
+
+static void test_checksum_matches_engine() {
+	// hash_djb2_buffer values, so entries written before the split stay valid.
+	CHECK(shader_cache_checksum(nullptr, 0) == 5381);
+	const uint8_t abc[] = { 'a', 'b', 'c' };
+	CHECK(shader_cache_checksum(abc, 3) == 193485963);
+}
+
+int main() {
+	test_round_trip();
+	test_unlinked_program_is_not_stored();
+	test_short_binary();
+	test_other_driver_is_stale();
+	test_other_version_is_stale();
+	test_damaged_entries_are_rejected();
+	test_driver_rejection();
+	test_checksum_matches_engine();
+
+	if (failures) {
+		printf("%d check(s) failed.\n", failures);
+		return 1;
+	}
+	printf("All shader cache checks passed.\n");
+	return 0;
+}
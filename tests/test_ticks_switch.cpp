@@ -0,0 +1,204 @@
+/**************************************************************************/
+/*  test_ticks_switch.cpp                                                 */
+/**************************************************************************/
+/*                         This file is part of:                          */
+/*                             GODOT ENGINE                               */
+/*                        https://godotengine.org                         */
+/**************************************************************************/
+/* Copyright (c) 2014-present Godot Engine contributors (see AUTHORS.md). */
+/* Copyright (c) 2007-2014 Juan Linietsky, Ariel Manzur.                  */
+/*                                                                        */
+/* Permission is hereby granted, free of charge, to any person obtaining  */
+/* a copy of this software and associated documentation files (the        */
+/* "Software"), to deal in the Software without restriction, including    */
+/* without limitation the rights to use, copy, modify, merge, publish,    */
+/* distribute, sublicense, and/or sell copies of the Software, and to     */
+/* permit persons to whom the Software is furnished to do so, subject to  */
+/* the following conditions:                                              */
+/*                                                                        */
+/* The above copyright notice and this permission notice shall be         */
+/* included in all copies or substantial portions of the Software.        */
+/*                                                                        */
+/* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,        */
+/* EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF     */
+/* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. */
+/* IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY   */
+/* CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,   */
+/* TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE      */
+/* SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.                 */
+/**************************************************************************/
+
+// Host test of the fixed-point tick to microsecond conversion against a
+// simulated tick source.
+// Build and run from this directory:
+//   c++ -std=c++11 -Wall -I.. test_ticks_switch.cpp -o test_ticks_switch && ./test_ticks_switch
+
+#include "ticks_switch.h"
+
+#include <stdio.h>
+
+static int failures = 0;
+
+#define CHECK(m_cond)                                                   \
+	do {                                                                \
+		if (!(m_cond)) {                                                \
+			printf("%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #m_cond); \
+			failures++;                                                 \
+		}                                                               \
+	} while (0)
+
+#define SWITCH_TICK_FREQ 19200000ull
+
+static uint64_t rng_state = 0x9E3779B97F4A7C15ull;
+
+static uint64_t rng() {
+	rng_state ^= rng_state << 13;
+	rng_state ^= rng_state >> 7;
+	rng_state ^= rng_state << 17;
+	return rng_state;
+}
+
+static uint64_t exact_usec(uint64_t p_ticks, uint64_t p_freq) {
+	return (uint64_t)((unsigned __int128)p_ticks * 1000000 / p_freq);
+}
+
+static uint64_t gcd(uint64_t p_a, uint64_t p_b) {
+	while (p_b) {
+		uint64_t t = p_a % p_b;
+		p_a = p_b;
+		p_b = t;
+	}
+	return p_a;
+}
+
+// Below this tick count the conversion has to be exact.
+static uint64_t exact_limit(uint64_t p_freq) {
+	return UINT64_MAX / (p_freq / gcd(p_freq, 1000000));
+}
+
+static void test_exact(uint64_t p_freq) {
+	uint64_t factor = ticks_switch_usec_factor(p_freq);
+	uint64_t limit = exact_limit(p_freq);
+	uint64_t period = p_freq / gcd(p_freq, 1000000);
+	int errors = 0;
+
+	// Every tick of the first seconds, where each rounding step is hit.
+	uint64_t count = 4 * p_freq < 4000000 ? 4 * p_freq : 4000000;
+	for (uint64_t t = 0; t < count; t++) {
+		errors += ticks_switch_to_usec(t, factor) != exact_usec(t, p_freq);
+	}
+
+	// Around the edges of a rounding step, spread over the exact range.
+	for (int i = 0; i < 200000; i++) {
+		uint64_t base = (rng() % (limit / period)) * period;
+		for (uint64_t j = 0; j < 2; j++) {
+			uint64_t t = base + j * (period - 1);
+			errors += ticks_switch_to_usec(t, factor) != exact_usec(t, p_freq);
+		}
+	}
+
+	// Up to the limit.
+	for (uint64_t t = limit - count; t < limit; t++) {
+		errors += ticks_switch_to_usec(t, factor) != exact_usec(t, p_freq);
+	}
+
+	if (errors) {
+		printf("%llu Hz: %d inexact conversions\n", (unsigned long long)p_freq, errors);
+	}
+	CHECK(errors == 0);
+}
+
+static void test_beyond_exact_range(uint64_t p_freq) {
+	// Past the exact range the result is never low, and at most 1 high.
+	uint64_t factor = ticks_switch_usec_factor(p_freq);
+	uint64_t limit = exact_limit(p_freq);
+	int errors = 0;
+	for (int i = 0; i < 200000; i++) {
+		uint64_t t = limit + rng() % (UINT64_MAX - limit);
+		uint64_t usec = ticks_switch_to_usec(t, factor);
+		uint64_t exact = exact_usec(t, p_freq);
+		errors += usec < exact || usec > exact + 1;
+	}
+	uint64_t usec = ticks_switch_to_usec(UINT64_MAX, factor);
+	errors += usec < exact_usec(UINT64_MAX, p_freq) || usec > exact_usec(UINT64_MAX, p_freq) + 1;
+	CHECK(errors == 0);
+}
+
+static void test_no_drift() {
+	// The old t / (freq / 1000000) divided by 19 instead of 19.2 and ran 1% fast.
+	uint64_t factor = ticks_switch_usec_factor(SWITCH_TICK_FREQ);
+	uint64_t hour = 3600 * SWITCH_TICK_FREQ;
+	CHECK(ticks_switch_to_usec(hour, factor) == 3600000000ull);
+	CHECK(ticks_switch_to_usec(1000 * hour, factor) == 3600000000000ull);
+	CHECK(hour / (SWITCH_TICK_FREQ / 1000000) != 3600000000ull);
+}
+
+// Stands in for armGetSystemTick(): starts anywhere and advances by uneven steps,
+// like calls spread over frames.
+struct SimulatedTicks {
+	uint64_t now;
+
+	uint64_t get() {
+		now += 1 + rng() % (2 * SWITCH_TICK_FREQ / 60);
+		return now;
+	}
+};
+
+static void test_simulated_source(uint64_t p_start) {
+	uint64_t factor = ticks_switch_usec_factor(SWITCH_TICK_FREQ);
+	SimulatedTicks ticks = { p_start };
+	uint64_t last_ticks = ticks.get();
+	uint64_t last_usec = ticks_switch_to_usec(last_ticks, factor);
+	int errors = 0;
+
+	for (int i = 0; i < 200000; i++) {
+		uint64_t t = ticks.get();
+		uint64_t usec = ticks_switch_to_usec(t, factor);
+
+		uint64_t exact_delta = exact_usec(t - last_ticks, SWITCH_TICK_FREQ);
+		if (t < last_ticks) {
+			// The counter wrapped, only the tick difference is meaningful.
+			errors += ticks_switch_to_usec(t - last_ticks, factor) != exact_delta;
+		} else {
+			// Monotonic, and frame deltas agree with the exact delta to the microsecond.
+			uint64_t delta = usec - last_usec;
+			errors += usec < last_usec || delta < exact_delta || delta > exact_delta + 1;
+		}
+
+		last_ticks = t;
+		last_usec = usec;
+	}
+	CHECK(errors == 0);
+}
+
+static void test_counter_wraparound() {
+	// The counter wraps after 2^64 ticks (~30000 years at 19.2 MHz). Absolute
+	// values jump back then, tick differences taken before conversion don't.
+	uint64_t factor = ticks_switch_usec_factor(SWITCH_TICK_FREQ);
+	uint64_t before = UINT64_MAX - SWITCH_TICK_FREQ / 2;
+	uint64_t after = before + SWITCH_TICK_FREQ; // wraps
+	CHECK(after < before);
+	CHECK(ticks_switch_to_usec(after, factor) < ticks_switch_to_usec(before, factor));
+	CHECK(ticks_switch_to_usec(after - before, factor) == 1000000);
+
+	test_simulated_source(UINT64_MAX - 1000 * SWITCH_TICK_FREQ);
+}
+
+int main() {
+	const uint64_t freqs[] = { SWITCH_TICK_FREQ, 19200001ull, 24000000ull, 62500000ull, 1000000007ull };
+	for (unsigned i = 0; i < sizeof(freqs) / sizeof(freqs[0]); i++) {
+		test_exact(freqs[i]);
+		test_beyond_exact_range(freqs[i]);
+	}
+	test_no_drift();
+	test_simulated_source(0);
+	test_simulated_source(rng() % exact_limit(SWITCH_TICK_FREQ));
+	test_counter_wraparound();
+
+	if (failures) {
+		printf("%d check(s) failed.\n", failures);
+		return 1;
+	}
+	printf("All tick conversion checks passed.\n");
+	return 0;
+}
@@ -0,0 +1,115 @@
+/**************************************************************************/
+/*  thread_switch.cpp                                                     */
+/**************************************************************************/
+/*                         This file is part of:                          */
+/*                             GODOT ENGINE                               */
+/*                        https://godotengine.org                         */
+/**************************************************************************/
+/* Copyright (c) 2014-present Godot Engine contributors (see AUTHORS.md). */
+/* Copyright (c) 2007-2014 Juan Linietsky, Ariel Manzur.                  */
+/*                                                                        */
+/* Permission is hereby granted, free of charge, to any person obtaining  */
+/* a copy of this software and associated documentation files (the        */
+/* "Software"), to deal in the Software without restriction, including    */
+/* without limitation the rights to use, copy, modify, merge, publish,    */
+/* distribute, sublicense, and/or sell copies of the Software, and to     */
+/* permit persons to whom the Software is furnished to do so, subject to  */
+/* the following conditions:                                              */
+/*                                                                        */
+/* The above copyright notice and this permission notice shall be         */
+/* included in all copies or substantial portions of the Software.        */
+/*                                                                        */
+/* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,        */
+/* EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF     */
+/* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. */
+/* IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY   */
+/* CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,   */
+/* TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE      */
+/* SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.                 */
+/**************************************************************************/
+
+#include "thread_switch.h"
+
+#include "core/os/thread.h"
+#include "core/project_settings.h"
+#include "switch_wrapper.h"
+
+#include <pthread.h>
+
+#define APPLICATION_CORE_MASK 0x7
+// svcSetThreadCoreMask ideal core value that leaves the ideal core as it is.
+#define IDEAL_CORE_NO_UPDATE -3
+#define THREAD_PRIORITY_MIN 0x1C
+#define THREAD_PRIORITY_MAX 0x3B
+
+static const char *role_names[ThreadSwitch::ROLE_MAX] = {
+	"main",
+	"render",
+	"audio",
+	"worker",
+	"background",
+};
+
+// Defaults keep the main thread alone on core 0, move GL submission to core 1 and
+// park audio and loaders on core 2, where audio preempts loading.
+static ThreadSwitch::Policy policies[ThreadSwitch::ROLE_MAX] = {
+	{ 0, 0x2C }, // main
+	{ 1, 0x2C }, // render
+	{ 2, 0x2B }, // audio
+	{ -1, 0x2C }, // worker
+	{ 2, 0x2D }, // background
+};
+
+#if !defined(NO_THREADS)
+// Same as the hook init_thread_posix() installs, which is file-local there;
+// _set_platform_funcs() replaces both hooks at once.
+static Error set_name(const String &p_name) {
+#ifdef PTHREAD_NO_RENAME
+	return ERR_UNAVAILABLE;
+#else
+	int err = pthread_setname_np(pthread_self(), p_name.utf8().get_data());
+	return err == 0 ? OK : ERR_INVALID_PARAMETER;
+#endif
+}
+
+static void set_priority(Thread::Priority p_priority) {
+	ThreadSwitch::apply(p_priority == Thread::PRIORITY_LOW ? ThreadSwitch::ROLE_BACKGROUND : ThreadSwitch::ROLE_WORKER);
+}
+#endif
+
+void ThreadSwitch::initialize() {
+#if !defined(NO_THREADS)
+	Thread::_set_platform_funcs(&set_name, &set_priority);
+#endif
+}
+
+void ThreadSwitch::load_settings() {
+	for (int i = 0; i < ROLE_MAX; i++) {
+		String base = String("application/run/switch/threads/") + role_names[i];
+
+		policies[i].core = GLOBAL_DEF(base + "_core", policies[i].core);
+		ProjectSettings::get_singleton()->set_custom_property_info(base + "_core", PropertyInfo(Variant::INT, base + "_core", PROPERTY_HINT_RANGE, "-1,2,1"));
+
+		policies[i].priority = GLOBAL_DEF(base + "_priority", policies[i].priority);
+		ProjectSettings::get_singleton()->set_custom_property_info(base + "_priority", PropertyInfo(Variant::INT, base + "_priority", PROPERTY_HINT_RANGE, itos(THREAD_PRIORITY_MIN) + "," + itos(THREAD_PRIORITY_MAX) + ",1"));
+	}
+}
+
+void ThreadSwitch::apply(Role p_role) {
+	ERR_FAIL_INDEX(p_role, ROLE_MAX);
+	const Policy &policy = policies[p_role];
+
+	if (policy.core >= 0 && policy.core <= 2) {
+		svcSetThreadCoreMask(CUR_THREAD_HANDLE, policy.core, 1u << policy.core);
+	} else {
+		// Keep the current ideal core and only widen the affinity.
+		svcSetThreadCoreMask(CUR_THREAD_HANDLE, IDEAL_CORE_NO_UPDATE, APPLICATION_CORE_MASK);
+	}
+
+	svcSetThreadPriority(CUR_THREAD_HANDLE, CLAMP(policy.priority, THREAD_PRIORITY_MIN, THREAD_PRIORITY_MAX));
+}
+
+ThreadSwitch::Policy ThreadSwitch::get_policy(Role p_role) {
+	ERR_FAIL_INDEX_V(p_role, ROLE_MAX, policies[ROLE_WORKER]);
+	return policies[p_role];
+}
@@ -0,0 +1,59 @@
+/**************************************************************************/
+/*  thread_switch.h                                                       */
+/**************************************************************************/
+/*                         This file is part of:                          */
+/*                             GODOT ENGINE                               */
+/*                        https://godotengine.org                         */
+/**************************************************************************/
+/* Copyright (c) 2014-present Godot Engine contributors (see AUTHORS.md). */
+/* Copyright (c) 2007-2014 Juan Linietsky, Ariel Manzur.                  */
+/*                                                                        */
+/* Permission is hereby granted, free of charge, to any person obtaining  */
+/* a copy of this software and associated documentation files (the        */
+/* "Software"), to deal in the Software without restriction, including    */
+/* without limitation the rights to use, copy, modify, merge, publish,    */
+/* distribute, sublicense, and/or sell copies of the Software, and to     */
+/* permit persons to whom the Software is furnished to do so, subject to  */
+/* the following conditions:                                              */
+/*                                                                        */
+/* The above copyright notice and this permission notice shall be         */
+/* included in all copies or substantial portions of the Software.        */
+/*                                                                        */
+/* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,        */
+/* EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF     */
+/* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. */
+/* IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY   */
+/* CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,   */
+/* TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE      */
+/* SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.                 */
+/**************************************************************************/
+
+#ifndef THREAD_SWITCH_H
+#define THREAD_SWITCH_H
+
+// Core affinity and priority policy for engine threads.
+// Horizon gives the application cores 0-2; lower priority values preempt higher ones.
+class ThreadSwitch {
+public:
+	enum Role {
+		ROLE_MAIN,
+		ROLE_RENDER,
+		ROLE_AUDIO,
+		ROLE_WORKER, // Thread::PRIORITY_NORMAL and PRIORITY_HIGH threads (physics, servers, ...)
+		ROLE_BACKGROUND, // Thread::PRIORITY_LOW threads (resource loaders, ...)
+		ROLE_MAX
+	};
+
+	struct Policy {
+		int core; // -1 lets the thread run on any application core
+		int priority;
+	};
+
+	static void initialize();
+	static void load_settings();
+
+	static void apply(Role p_role);
+	static Policy get_policy(Role p_role);
+};
+
+#endif // THREAD_SWITCH_H
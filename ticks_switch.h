@@ -0,0 +1,52 @@
+/**************************************************************************/
+/*  ticks_switch.h                                                        */
+/**************************************************************************/
+/*                         This file is part of:                          */
+/*                             GODOT ENGINE                               */
+/*                        https://godotengine.org                         */
+/**************************************************************************/
+/* Copyright (c) 2014-present Godot Engine contributors (see AUTHORS.md). */
+/* Copyright (c) 2007-2014 Juan Linietsky, Ariel Manzur.                  */
+/*                                                                        */
+/* Permission is hereby granted, free of charge, to any person obtaining  */
+/* a copy of this software and associated documentation files (the        */
+/* "Software"), to deal in the Software without restriction, including    */
+/* without limitation the rights to use, copy, modify, merge, publish,    */
+/* distribute, sublicense, and/or sell copies of the Software, and to     */
+/* permit persons to whom the Software is furnished to do so, subject to  */
+/* the following conditions:                                              */
+/*                                                                        */
+/* The above copyright notice and this permission notice shall be         */
+/* included in all copies or substantial portions of the Software.        */
+/*                                                                        */
+/* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,        */
+/* EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF     */
+/* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. */
+/* IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY   */
+/* CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,   */
+/* TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE      */
+/* SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.                 */
+/**************************************************************************/
+
+#ifndef TICKS_SWITCH_H
+#define TICKS_SWITCH_H
+
+#include <stdint.h>
+
+// Ticks to microseconds as a 0.64 fixed-point factor, rounded up so that
+// (ticks * factor) >> 64 == ticks * 1000000 / freq exactly while the rounding
+// error stays below the smallest fraction the quotient can have: up to 2^64 / 96
+// ticks at 19.2 MHz, about 300 years of uptime. Past that it is at most 1 high.
+// Kept free of libnx so it can be built on the host, see tests/test_ticks_switch.cpp.
+
+// p_freq has to be above 1 MHz for the factor to fit (the Switch runs at 19.2 MHz).
+static inline uint64_t ticks_switch_usec_factor(uint64_t p_freq) {
+	const unsigned __int128 freq = p_freq;
+	return (uint64_t)((((unsigned __int128)1000000 << 64) + freq - 1) / freq);
+}
+
+static inline uint64_t ticks_switch_to_usec(uint64_t p_ticks, uint64_t p_factor) {
+	return (uint64_t)(((unsigned __int128)p_ticks * p_factor) >> 64);
+}
+
+#endif // TICKS_SWITCH_H